@@ -0,0 +1,227 @@
+/* Copyright (c) 2012. MRSG Team. All rights reserved. */
+
+/* This file is part of MRSG.
+
+MRSG is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+MRSG is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <xbt/asserts.h>
+#include <mrsg.h>
+
+/**
+ * MRSG benchmark suite.
+ *
+ * Usage: mrsg_bench.bin [quick|full] [results.csv]
+ *
+ * Scales the workers, the input chunks and the reduces, one at a time from
+ * 100 workers, 1000 chunks and 10 reduces, on a generated platform (a
+ * single cluster of 1 Gflop/s hosts). Each scenario runs in its own
+ * process, and adds a line to the results file with the simulator wall
+ * time, the peak RSS, the master loop iterations and the messages per
+ * simulated and per wall clock second. The logs of the simulations go to
+ * mrsg_bench.log.
+ */
+
+#define PLATFORM_FILE "mrsg_bench.xml"
+#define DEPLOY_FILE "mrsg_bench.deploy.xml"
+#define CONFIG_FILE "mrsg_bench.conf"
+#define LOG_FILE "mrsg_bench.log"
+
+struct scenario_s {
+    const char*  name;
+    int          workers;
+    int          chunks;
+    int          reduces;
+    int          quick;	/* Part of the quick suite. */
+};
+
+static struct scenario_s scenarios[] = {
+    { "workers",    10,   1000,    10,  1 },
+    { "workers",   100,   1000,    10,  1 },
+    { "workers",  1000,   1000,    10,  1 },
+    { "workers", 10000,   1000,    10,  0 },
+    { "chunks",    100,    100,    10,  1 },
+    { "chunks",    100,   1000,    10,  1 },
+    { "chunks",    100,  10000,    10,  1 },
+    { "chunks",    100, 100000,    10,  0 },
+    { "chunks",    100, 1000000,   10,  0 },
+    { "reduces",   100,   1000,     1,  1 },
+    { "reduces",   100,   1000,    10,  1 },
+    { "reduces",   100,   1000,   100,  1 },
+    { "reduces",   100,   1000,  1000,  1 },
+    { "reduces",   100,   1000, 10000,  0 }
+};
+
+static struct scenario_s* current;
+
+/* Every map emits as much as it reads (a 64 MB chunk), spread evenly. */
+uint64_t bench_map_output (size_t jid, size_t mid, size_t rid)
+{
+    return 64ULL * 1024 * 1024 / current->reduces;
+}
+
+/* 10 s per map, and 0.1 s per map output read by a reduce. */
+double bench_task_cost (size_t jid, enum phase_e phase, size_t tid, size_t wid)
+{
+    switch (phase)
+    {
+	case MAP:
+	    return 1e+10;
+
+	case REDUCE:
+	    return 1e+8 * current->chunks / current->reduces;
+    }
+
+    return 0.0;
+}
+
+/**
+ * Write the platform, deployment and configuration of a scenario.
+ */
+static void write_inputs (struct scenario_s* sc)
+{
+    FILE*  file;
+    int    i;
+
+    file = fopen (PLATFORM_FILE, "w");
+    xbt_assert (file != NULL, "Error writing %s", PLATFORM_FILE);
+    fprintf (file, "<?xml version='1.0'?>\n"
+	    "<!DOCTYPE platform SYSTEM \"http://simgrid.gforge.inria.fr/simgrid.dtd\">\n"
+	    "<platform version=\"3\">\n"
+	    "<AS id=\"AS0\" routing=\"Full\">\n"
+	    "  <cluster id=\"bench\" prefix=\"node-\" suffix=\".bench\" radical=\"0-%d\"\n"
+	    "           power=\"1E9\" bw=\"1.25E8\" lat=\"5E-5\" bb_bw=\"1.25E10\" bb_lat=\"5E-4\"/>\n"
+	    "</AS>\n"
+	    "</platform>\n", sc->workers);
+    fclose (file);
+
+    file = fopen (DEPLOY_FILE, "w");
+    xbt_assert (file != NULL, "Error writing %s", DEPLOY_FILE);
+    fprintf (file, "<?xml version='1.0'?>\n"
+	    "<!DOCTYPE platform SYSTEM \"http://simgrid.gforge.inria.fr/simgrid.dtd\">\n"
+	    "<platform version=\"3\">\n"
+	    "  <process host=\"node-0.bench\" function=\"master\"/>\n");
+    for (i = 1; i <= sc->workers; i++)
+	fprintf (file, "  <process host=\"node-%d.bench\" function=\"worker\"/>\n", i);
+    fprintf (file, "</platform>\n");
+    fclose (file);
+
+    file = fopen (CONFIG_FILE, "w");
+    xbt_assert (file != NULL, "Error writing %s", CONFIG_FILE);
+    fprintf (file, "chunk_size 64\ninput_chunks %d\nreduces %d\n"
+	    "dfs_replicas 3\nmap_slots 2\nreduce_slots 2\ntask_trace none\n",
+	    sc->chunks, sc->reduces);
+    fclose (file);
+}
+
+/**
+ * Run a scenario and append its results. Called in a child process.
+ */
+static int run_scenario (struct scenario_s* sc, const char* results)
+{
+    double              wall;
+    FILE*               file;
+    int                 res;
+    struct mrsg_perf_s  perf;
+    struct rusage       usage;
+    struct timeval      begin, end;
+
+    current = sc;
+    write_inputs (sc);
+
+    if (freopen (LOG_FILE, "a", stdout) == NULL || dup2 (fileno (stdout), STDERR_FILENO) < 0)
+	return 1;
+
+    MRSG_init ();
+    MRSG_set_task_cost_f (bench_task_cost);
+    MRSG_set_map_output_f (bench_map_output);
+    MRSG_set_trace_level (MRSG_TRACE_OFF);
+
+    gettimeofday (&begin, NULL);
+    res = MRSG_main (PLATFORM_FILE, DEPLOY_FILE, CONFIG_FILE);
+    gettimeofday (&end, NULL);
+
+    wall = (end.tv_sec - begin.tv_sec) + (end.tv_usec - begin.tv_usec) / 1e6;
+    getrusage (RUSAGE_SELF, &usage);
+    MRSG_get_perf (&perf);
+
+    file = fopen (results, "a");
+    xbt_assert (file != NULL, "Error writing benchmark results: %s", results);
+    fprintf (file, "%s,%d,%d,%d,%d,%.3f,%ld,%.3f,%llu,%llu,%.1f,%.1f\n",
+	    sc->name, sc->workers, sc->chunks, sc->reduces, res, wall, usage.ru_maxrss,
+	    perf.simulated_time, (unsigned long long) perf.master_iterations,
+	    (unsigned long long) perf.messages,
+	    (perf.simulated_time > 0.0 ? perf.messages / perf.simulated_time : 0.0),
+	    (wall > 0.0 ? perf.messages / wall : 0.0));
+    fclose (file);
+
+    return res;
+}
+
+int main (int argc, char* argv[])
+{
+    const char*  results = "bench.csv";
+    FILE*        file;
+    int          failed = 0;
+    int          full = 0;
+    int          status;
+    pid_t        pid;
+    size_t       i;
+
+    if (argc > 1)
+	full = (strcmp (argv[1], "full") == 0);
+    if (argc > 2)
+	results = argv[2];
+
+    file = fopen (results, "w");
+    xbt_assert (file != NULL, "Error writing benchmark results: %s", results);
+    fprintf (file, "scenario,workers,chunks,reduces,status,wall_time,peak_rss_kb,simulated_time,"
+	    "master_iterations,messages,messages_per_simulated_second,messages_per_wall_second\n");
+    fclose (file);
+    remove (LOG_FILE);
+
+    /* One process per scenario: SimGrid loads a single platform per process. */
+    for (i = 0; i < sizeof (scenarios) / sizeof (scenarios[0]); i++)
+    {
+	if (!full && !scenarios[i].quick)
+	    continue;
+
+	printf ("%s: %d workers, %d chunks, %d reduces\n", scenarios[i].name,
+		scenarios[i].workers, scenarios[i].chunks, scenarios[i].reduces);
+	fflush (stdout);
+
+	pid = fork ();
+	if (pid == 0)
+	    _exit (run_scenario (&scenarios[i], results));
+
+	if (pid < 0 || waitpid (pid, &status, 0) < 0 || !WIFEXITED (status) || WEXITSTATUS (status) != 0)
+	    failed = 1;
+    }
+
+    remove (PLATFORM_FILE);
+    remove (DEPLOY_FILE);
+    remove (CONFIG_FILE);
+
+    printf ("results: %s\n", results);
+
+    return failed;
+}
+
+// vim: set ts=8 sw=4:
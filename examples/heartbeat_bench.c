@@ -0,0 +1,36 @@
+#include <stdio.h>
+#include <sys/time.h>
+#include "hello_functions.h"
+
+/**
+ * Compare the polling and push heartbeat modes.
+ *
+ * Run with a configuration file as argument, once with
+ * "heartbeat_mode poll" and once with "heartbeat_mode push" in it
+ * (see heartbeat_bench.sh). The simulated makespan is the time of the
+ * "JOB END" line of the log.
+ */
+
+int main (int argc, char* argv[])
+{
+    const char*     conf = "hello.conf";
+    struct timeval  begin, end;
+
+    if (argc > 1)
+	conf = argv[1];
+
+    MRSG_init ();
+    MRSG_set_task_cost_f (my_task_cost_function);
+    MRSG_set_map_output_f (my_map_output_function);
+
+    gettimeofday (&begin, NULL);
+    MRSG_main ("g5k.xml", "hello.deploy.xml", conf);
+    gettimeofday (&end, NULL);
+
+    fprintf (stderr, "wall time: %.3f s\n",
+	    (end.tv_sec - begin.tv_sec) + (end.tv_usec - begin.tv_usec) / 1e6);
+
+    return 0;
+}
+
+// vim: set ts=8 sw=4:
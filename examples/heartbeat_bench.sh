@@ -0,0 +1,19 @@
+#!/bin/sh
+# Compare the simulated makespan and the simulator wall time of the
+# polling and push heartbeat modes, using hello.conf as the base job.
+
+make heartbeat_bench.bin || exit 1
+
+for mode in poll push
+do
+    conf="heartbeat_$mode.conf"
+    grep -v "^heartbeat_mode" hello.conf > "$conf"
+    echo "heartbeat_mode $mode" >> "$conf"
+
+    ./heartbeat_bench.bin "$conf" > "heartbeat_$mode.log" 2>&1
+    makespan=$(grep "JOB END" "heartbeat_$mode.log" | sed 's/.* \([0-9.]*\)\] .*/\1/')
+    wall=$(grep "wall time" "heartbeat_$mode.log" | sed 's/wall time: //')
+    echo "$mode: makespan $makespan s, wall time $wall"
+
+    rm -f "$conf"
+done
@@ -4,11 +4,12 @@
  * User function that indicates the amount of bytes
  * that a map task will emit to a reduce task.
  *
+ * @param  jid  The ID of the job.
  * @param  mid  The ID of the map task.
  * @param  rid  The ID of the reduce task.
  * @return The amount of data emitted (in bytes).
  */
-int my_map_output_function (size_t mid, size_t rid)
+uint64_t my_map_output_function (size_t jid, size_t mid, size_t rid)
 {
     return 4*1024*1024;
 }
@@ -17,12 +18,13 @@ int my_map_output_function (size_t mid, size_t rid)
 /**
  * User function that indicates the cost of a task.
  *
+ * @param  jid    The ID of the job.
  * @param  phase  The execution phase.
  * @param  tid    The ID of the task.
  * @param  wid    The ID of the worker that received the task.
  * @return The task cost in FLOPs.
  */
-double my_task_cost_function (enum phase_e phase, size_t tid, size_t wid)
+double my_task_cost_function (size_t jid, enum phase_e phase, size_t tid, size_t wid)
 {
     switch (phase)
     {
@@ -32,6 +34,8 @@ double my_task_cost_function (enum phase_e phase, size_t tid, size_t wid)
 	case REDUCE:
 	    return 5e+11;
     }
+
+    return 0.0;
 }
 
 int main (int argc, char* argv[])
@@ -42,8 +46,8 @@ int main (int argc, char* argv[])
     MRSG_set_task_cost_f (my_task_cost_function);
     /* Set the map output function. */
     MRSG_set_map_output_f (my_map_output_function);
-    /* Run the simulation. */
-    MRSG_main ("g5k.xml", "hello.deploy.xml", "hello.conf");
+    /* Run the simulation, forwarding the command line to SimGrid. */
+    MRSG_main_args (argc, argv, "g5k.xml", "hello.deploy.xml", "hello.conf");
 
     return 0;
 }
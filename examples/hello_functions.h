@@ -0,0 +1,47 @@
+#ifndef HELLO_FUNCTIONS_H
+#define HELLO_FUNCTIONS_H
+
+#include <mrsg.h>
+
+/* The user functions of hello.c, shared by the examples built on it. */
+
+/**
+ * User function that indicates the amount of bytes
+ * that a map task will emit to a reduce task.
+ *
+ * @param  jid  The ID of the job.
+ * @param  mid  The ID of the map task.
+ * @param  rid  The ID of the reduce task.
+ * @return The amount of data emitted (in bytes).
+ */
+static uint64_t my_map_output_function (size_t jid, size_t mid, size_t rid)
+{
+    return 4*1024*1024;
+}
+
+/**
+ * User function that indicates the cost of a task.
+ *
+ * @param  jid    The ID of the job.
+ * @param  phase  The execution phase.
+ * @param  tid    The ID of the task.
+ * @param  wid    The ID of the worker that received the task.
+ * @return The task cost in FLOPs.
+ */
+static double my_task_cost_function (size_t jid, enum phase_e phase, size_t tid, size_t wid)
+{
+    switch (phase)
+    {
+	case MAP:
+	    return 1e+11;
+
+	case REDUCE:
+	    return 5e+11;
+    }
+
+    return 0.0;
+}
+
+#endif /* !HELLO_FUNCTIONS_H */
+
+// vim: set ts=8 sw=4:
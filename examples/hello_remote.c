@@ -1,17 +1,18 @@
 #include <mrsg.h>
 #include <scheduling.h>
 
-size_t choose_remote_map_task (size_t wid);
+size_t choose_remote_map_task (job_t job, size_t wid);
 
 /**
  * User function that indicates the amount of bytes
  * that a map task will emit to a reduce task.
  *
+ * @param  jid  The ID of the job.
  * @param  mid  The ID of the map task.
  * @param  rid  The ID of the reduce task.
  * @return The amount of data emitted (in bytes).
  */
-int my_map_output_function (size_t mid, size_t rid)
+uint64_t my_map_output_function (size_t jid, size_t mid, size_t rid)
 {
     return 4*1024*1024;
 }
@@ -20,12 +21,13 @@ int my_map_output_function (size_t mid, size_t rid)
 /**
  * User function that indicates the cost of a task.
  *
+ * @param  jid    The ID of the job.
  * @param  phase  The execution phase.
  * @param  tid    The ID of the task.
  * @param  wid    The ID of the worker that received the task.
  * @return The task cost in FLOPs.
  */
-double my_task_cost_function (enum phase_e phase, size_t tid, size_t wid)
+double my_task_cost_function (size_t jid, enum phase_e phase, size_t tid, size_t wid)
 {
     switch (phase)
     {
@@ -35,23 +37,28 @@ double my_task_cost_function (enum phase_e phase, size_t tid, size_t wid)
 	case REDUCE:
 	    return 5e+11;
     }
+
+    return 0.0;
 }
 
 /**
  * @brief  Chooses a map or reduce task and send it to a worker.
+ * @param  jid    The job id.
  * @param  phase  MAP or REDUCE.
  * @param  wid  Worker id.
  * @return Chosen task id.
  */
-size_t remote_scheduler_f (enum phase_e phase, size_t wid)
+size_t remote_scheduler_f (size_t jid, enum phase_e phase, size_t wid)
 {
+    job_t  job = workload.jobs[jid];
+
     switch (phase)
     {
 	case MAP:
-	    return choose_remote_map_task (wid);
+	    return choose_remote_map_task (job, wid);
 
 	case REDUCE:
-	    return choose_default_reduce_task (wid);
+	    return choose_default_reduce_task (job, wid);
 
 	default:
 	    return NONE;
@@ -60,29 +67,30 @@ size_t remote_scheduler_f (enum phase_e phase, size_t wid)
 
 /**
  * @brief  Choose a map task, and send it to a worker.
+ * @param  job  The job.
  * @param  wid  Worker id.
  */
-size_t choose_remote_map_task (size_t wid)
+size_t choose_remote_map_task (job_t job, size_t wid)
 {
     size_t           chunk;
     size_t           tid = NONE;
     enum task_type_e task_type, best_task_type = NO_TASK;
 
-    if (job.tasks_pending[MAP] <= 0)
+    if (job->tasks_pending[MAP] <= 0)
 	return tid;
 
     /* Look for a task for the worker. */
-    for (chunk = 0; chunk < config.chunk_count; chunk++)
+    for (chunk = 0; chunk < job->chunk_count; chunk++)
     {
-	task_type = get_task_type (MAP, chunk, wid);
+	task_type = get_task_type (job, MAP, chunk, wid);
 
-	if (task_type == REMOTE)
+	if (task_type == REMOTE || task_type == RACK)
 	{
 	    tid = chunk;
 	    break;
 	}
 	else if (task_type == LOCAL
-		|| (job.task_instances[MAP][chunk] < 2 // Speculative
+		|| (job->task_instances[MAP][chunk] < 2 // Speculative
 		    && task_type < best_task_type ))   // tasks.
 	{
 	    best_task_type = task_type;
@@ -0,0 +1,14 @@
+#include "hello_functions.h"
+
+int main (int argc, char* argv[])
+{
+    /* MRSG_init must be called before setting the user functions. */
+    MRSG_init ();
+    /* Set the task cost function. */
+    MRSG_set_task_cost_f (my_task_cost_function);
+    /* Set the map output function. */
+    MRSG_set_map_output_f (my_map_output_function);
+    /* Run hello.conf for every point of hello.sweep, one process per core. */
+    return MRSG_sweep ("g5k.xml", "hello.deploy.xml", "hello.conf", "hello.sweep", "sweep.csv", 0);
+}
+
@@ -27,25 +27,74 @@ along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
 /* Hearbeat parameters. */
 #define HEARTBEAT_MIN_INTERVAL 3
 #define HEARTBEAT_TIMEOUT 600
+#define HEARTBEAT_TIMEOUT_BEATS 10	/* Least default timeout, in heartbeats. */
+#define KEEPALIVE_INTERVAL 60
 
-/* Short message names. */
-#define SMS_GET_CHUNK "SMS-GC"
-#define SMS_GET_INTER_PAIRS "SMS-GIP"
-#define SMS_HEARTBEAT "SMS-HB"
-#define SMS_TASK "SMS-T"
-#define SMS_TASK_DONE "SMS-TD"
-#define SMS_FINISH "SMS-F"
+/* Shuffle parameters (Hadoop 0.20.2 defaults). */
+#define PARALLEL_COPIES 5
+#define COPY_BACKOFF 300
+#define COPY_BACKOFF_INIT 4
+#define COPY_POLL_INTERVAL 5
+
+/* Wait of the DFS client after a failed read (Hadoop 0.20.2). */
+#define DFS_RETRY_INTERVAL 3
+
+/* Disk parameters (Hadoop 0.20.2 defaults). */
+#define IO_SORT_MB 100
+#define IO_SORT_FACTOR 10
+
+/* Intermediate compression codecs: ratio, and compress/decompress MB/s on
+ * a host of average speed. */
+#define SNAPPY_RATIO 0.5
+#define SNAPPY_COMPRESS 250
+#define SNAPPY_DECOMPRESS 500
+#define LZO_RATIO 0.5
+#define LZO_COMPRESS 200
+#define LZO_DECOMPRESS 400
+#define GZIP_RATIO 0.33
+#define GZIP_COMPRESS 25
+#define GZIP_DECOMPRESS 100
+
+/* Container parameters (YARN defaults). */
+#define NODE_MEMORY_MB 8192
+#define NODE_VCORES 8
+#define CONTAINER_MEMORY_MB 1024
+#define CONTAINER_VCORES 1
+
+/* Pools (fair scheduler) and queues (capacity scheduler). */
+#define POOL_NAME_SIZE 64
+#define DEFAULT_POOL "default"
+
+#define DEFAULT_SEED 12345
 
 #define NONE (-1)
 #define MAX_SPECULATIVE_COPIES 3
+#define SPECULATIVE_LAG 60
 
 /* Mailbox related. */
 #define MAILBOX_ALIAS_SIZE 256
+#define WORKER_MAILBOX_SIZE 32
 #define MASTER_MAILBOX "MASTER"
 #define DATANODE_MAILBOX "%zu:DN"
 #define TASKTRACKER_MAILBOX "%zu:TT"
+#define DISK_MAILBOX "%zu:DISK"
 #define TASK_MAILBOX "%zu:%d"
 
+/** @brief  Message kinds. */
+enum sms_kind_e {
+    SMS_GET_CHUNK,
+    SMS_GET_INTER_PAIRS,
+    SMS_HEARTBEAT,
+    SMS_TASK,
+    SMS_TASK_DONE,
+    SMS_FINISH,
+    SMS_SUBMIT,
+    SMS_DISK,
+    SMS_DATA_CHUNK,
+    SMS_DATA_PAIRS,
+    SMS_DATA_LOST
+};
+
 /** @brief  Possible task status. */
 enum task_status_e {
     /* The initial status must be the first enum. */
@@ -57,94 +106,360 @@ enum task_status_e {
 
 enum task_type_e {
     LOCAL,
+    RACK,
     REMOTE,
     LOCAL_SPEC,
+    RACK_SPEC,
     REMOTE_SPEC,
     NORMAL,
     SPECULATIVE,
     NO_TASK
 };
 
-/** @brief  Information sent by the workers with every heartbeat. */
-struct heartbeat_s {
-    int  slots_av[2];
+/** @brief  How workers report free slots to the master. */
+enum heartbeat_mode_e {
+    HB_POLL,	/* Periodic heartbeats, as in Hadoop. */
+    HB_PUSH	/* Report on task completion, plus a long keepalive. */
 };
 
-typedef struct heartbeat_s* heartbeat_t;
+/** @brief  How the resources of the workers are divided among tasks. */
+enum resource_model_e {
+    RM_SLOTS,		/* Fixed slots of each phase, as in Hadoop 1. */
+    RM_CONTAINERS	/* Memory and vcores requested by every task, as in YARN. */
+};
+
+/* Entries of a resource vector. With slots, the free slots of each phase
+ * (indexed by phase); with containers, the memory (MB) and the vcores. */
+#define RESOURCES 2
+#define RES_MEMORY 0
+#define RES_VCORES 1
+
+/** @brief  A resource vector, also sent by the workers with every heartbeat. */
+struct resources_s {
+    int  amount[RESOURCES];
+};
+
+typedef struct resources_s* resources_t;
+
+/**
+ * @brief  Header of a message, attached as the task data.
+ *
+ * The task messages (SMS_TASK and SMS_TASK_DONE) carry their task_info_s
+ * instead, which also starts with the kind.
+ */
+typedef struct message_s {
+    enum sms_kind_e     kind;		/* Must be the first field. */
+    size_t              wid;		/* Sender of SMS_HEARTBEAT. */
+    struct resources_s  heartbeat;	/* Resources freed since the previous SMS_HEARTBEAT. */
+    int                 restarted;	/* First SMS_HEARTBEAT after a failure. */
+    const char*         reply;		/* Where to answer a request. */
+    void*               data;
+}* message_t;
+
+/**
+ * @brief  A pool of the fair scheduler, or a queue of the capacity scheduler.
+ *
+ * Shares and capacities apply to the slots of each phase separately.
+ */
+struct pool_s {
+    char    name[POOL_NAME_SIZE];
+    int     min_share;		/* Fair: guaranteed slots. */
+    double  weight;		/* Fair: share of the remaining slots. */
+    double  capacity;		/* Capacity: guaranteed fraction of the slots. */
+    double  max_capacity;	/* Capacity: limit when using idle slots. */
+    int     running[2];
+    int     demand[2];
+    double  starved_since[2];
+};
 
 struct config_s {
     double         chunk_size;
     double         grid_average_speed;
     double         grid_cpu_power;
-    int            chunk_count;
+    int            chunk_count;	/* Of the job in the configuration file. */
     int            chunk_replicas;
     int            heartbeat_interval;
-    int            amount_of_tasks[2];
+    int            keepalive_interval;
+    double         heartbeat_timeout;	/* Until a silent worker is lost, 0 if not set. */
+    int            parallel_copies;
+    double         copy_backoff;
+    enum heartbeat_mode_e heartbeat_mode;
+    int            amount_of_tasks[2];	/* Of the job in the configuration file. */
+    char*          workload_trace;
+    char*          job_history;	/* Replayed instead of the workload trace. */
+    char*          task_trace;	/* NULL if disabled. */
+    enum trace_level_e trace_level;
+    char*          results_file;	/* Summary of the run, in CSV. */
+    unsigned int   seed;
+    char*          failure_trace;	/* NULL if there is none. */
+    double         failure_mtbf;	/* Seconds, zero disables random failures. */
+    double         failure_mttr;
+    size_t         pool_count;
+    struct pool_s* pools;
+    double         preemption_timeout;
+    int            locality_delay;
+    int            rack_locality_delay;
+    double         speculative_cap;
+    double         slow_task_threshold;
+    double         slow_node_threshold;
+    double         reduce_slowstart;
+    int            adaptive_slowstart;
+    double         disk_read_bandwidth;	/* Bytes/s, zero disables the disk model. */
+    double         disk_write_bandwidth;
+    uint64_t       io_sort_buffer;
+    int            io_sort_factor;
+    double         combiner_ratio;	/* Output kept by the combiner, 1 if none. */
+    double         combiner_cost;	/* Flops per byte of map output. */
+    double         compress_ratio;	/* 1 if the map output is not compressed. */
+    double         compress_speed;	/* Bytes/s. */
+    double         decompress_speed;
     int            number_of_workers;
-    int            slots[2];
+    enum resource_model_e resource_model;
+    int            slots[2];	/* Of a worker, unless its host says otherwise. */
+    struct resources_s  node_resources;	/* Containers: memory and vcores of a worker. */
+    struct resources_s  container[2];	/* Containers: request of a task of each phase. */
+    struct resources_s  demand[2];	/* Taken by a task of each phase. */
+    struct resources_s* capacity;	/* Of every worker. */
+    int            total_slots[2];	/* Tasks of each phase the workers can run at once. */
     int            initialized;
+    msg_host_t     master;
     msg_host_t*    workers;
-} config;
+    /* Racks are the routing zones (ASes) of the platform that hold workers. */
+    size_t         rack_count;
+    size_t*        worker_rack;
+    size_t*        rack_start;	/* Workers of rack r: rack_worker[rack_start[r]..rack_start[r+1]-1] */
+    size_t*        rack_worker;
+};
+
+extern struct config_s config;
+
+/**
+ * @brief  Replica lists of the chunks, in compressed sparse row layout.
+ *
+ * The owners of chunk c are owner[chunk_start[c]] .. owner[chunk_start[c+1]-1],
+ * and the chunks of worker w are chunk[worker_start[w]] .. chunk[worker_start[w+1]-1],
+ * in ascending order. The chunks with a replica in rack r are
+ * rack_chunk[rack_start[r]] .. rack_chunk[rack_start[r+1]-1], also in order.
+ */
+struct chunk_owner_s {
+    size_t*  owner;
+    size_t*  chunk_start;
+    size_t*  chunk;
+    size_t*  worker_start;
+    size_t*  rack_chunk;
+    size_t*  rack_start;
+};
+
+/**
+ * @brief  Output of every map task to every reduce task.
+ *
+ * The user function is evaluated once. The matrix is kept dense (M x R,
+ * row per map) unless most entries are zero, in which case only the
+ * non-zero entries of each row are kept, sorted by reduce ID.
+ */
+struct output_s {
+    int        sparse;
+    uint64_t*  bytes;
+    size_t*    rid;
+    size_t*    map_start;
+    uint64_t*  map_total;
+    uint64_t*  reduce_total;
+    uint64_t   total;
+};
 
+struct stats_s {
+    int   map_local;
+    int   map_rack;
+    int   map_remote;
+    int   map_spec_l;
+    int   map_spec_rk;
+    int   map_spec_r;
+    int   reduce_normal;
+    int   reduce_spec;
+    int   map_skips;	/* Offers declined by delay scheduling. */
+    int   workers_lost;
+    int   maps_reexecuted;	/* Completed maps whose output was lost. */
+};
+
+extern struct stats_s stats;
+
+typedef struct job_s* job_t;
+
+/** @brief  State of a MapReduce job. */
 struct job_s {
+    size_t        id;
+    double        submit_time;
+    double        start_time;
+    double        end_time;
     int           finished;
+    size_t        pool;
+    int           running[2];
+    int           skip_count;	/* Offers declined since the last local map. */
+    /* Progress rates of the running copies (see speculation.c). */
+    double        rate_sum[2];
+    int           rate_count[2];
+    int           chunk_count;
+    int           amount_of_tasks[2];
+    /* Constant costs from the workload trace, instead of the user functions. */
+    int           has_profile;
+    double        profile_cost[2];
+    uint64_t      profile_output;
+    struct history_s*     history;	/* Replayed tasks, or NULL. */
     int           tasks_pending[2];
     int*          task_instances[2];
     int*          task_status[2];
     msg_task_t**  task_list[2];
-    size_t**      map_output;
-    heartbeat_t   heartbeats;
-} job;
+    uint64_t**    map_output;
+    size_t*       map_worker;	/* Holder of the output of each done map. */
+    struct chunk_owner_s  chunk_owner;	/* Replicas on the live workers. */
+    struct chunk_owner_s  replicas;	/* All replicas, once some were lost. */
+    struct output_s       output;
+    /* Map locality index (see scheduling.c). */
+    size_t*       local_next;
+    size_t*       rack_next;
+    size_t        remote_next;
+    size_t*       spec_set;
+    size_t*       spec_pos;
+    size_t        spec_count;
+    /* Running shuffles of each reduce task (see worker.c). */
+    struct shuffle_s**    shuffles;
+    struct stats_s        stats;
+};
+
+/** @brief  The jobs of the simulation. */
+struct workload_s {
+    int           finished;
+    size_t        job_count;
+    size_t        jobs_done;
+    job_t*        jobs;		/* In submission order. */
+    job_t*        active;	/* Submitted jobs that are not finished. */
+    size_t        active_count;
+    resources_t   heartbeats;	/* Free resources of every worker. */
+    /* Worker failures, as seen by the master (see master.c). */
+    double*       last_seen;
+    char*         lost;
+    int*          failures;
+    double        next_expiry;
+    /* Observed copies of map output, for the adaptive reduce slow-start. */
+    double        copy_bytes;
+    double        copy_time;
+    double        start_clock;	/* SimGrid clock at the start of the run. */
+};
+
+extern struct workload_s workload;
+
+/** @brief  Simulator counters, kept after the end of a run. */
+extern struct mrsg_perf_s perf;
 
 /** @brief  Information sent as the task data. */
 struct task_info_s {
+    enum sms_kind_e kind;	/* SMS_TASK or SMS_TASK_DONE, must be the first field. */
+    job_t         job;
     enum phase_e  phase;
     size_t        id;
     size_t        src;
     size_t        wid;
     int           pid;
     msg_task_t    task;
-    size_t*       map_output_copied;
+    double        start_time;
     double        shuffle_end;
+    int           killed;	/* Preempted, or cancelled by another copy. */
+    int           lost;		/* Its worker failed. */
+    int           refs;		/* Held by the master and by the worker. */
+    int           speculative;
+    size_t        running_pos;	/* In the running set of the worker. */
+    double        rate;		/* Progress per second. */
+    int           rated;	/* Counted in the mean rate of its job. */
+    double        time_left;
+    char          mailbox[WORKER_MAILBOX_SIZE];	/* Of the process that runs it. */
 };
 
 typedef struct task_info_s* task_info_t;
 
-struct stats_s {
-    int   map_local;
-    int   map_remote;
-    int   map_spec_l;
-    int   map_spec_r;
-    int   reduce_normal;
-    int   reduce_spec;
-} stats;
-
 struct user_s {
-    double (*task_cost_f)(enum phase_e phase, size_t tid, size_t wid);
-    void (*dfs_f)(char** dfs_matrix, size_t chunks, size_t workers, int replicas);
-    int (*map_output_f)(size_t mid, size_t rid);
-    size_t (*scheduler_f)(enum phase_e phase, size_t wid);
-} user;
+    double (*task_cost_f)(size_t jid, enum phase_e phase, size_t tid, size_t wid);
+    void (*dfs_f)(size_t chunks, size_t workers, int replicas);
+    uint64_t (*map_output_f)(size_t jid, size_t mid, size_t rid);
+    size_t (*scheduler_f)(size_t jid, enum phase_e phase, size_t wid);
+};
+
+extern struct user_s user;
+
+/**
+ * @brief  The workers of a deployment, with their speeds and racks.
+ *
+ * Lets the runs after the first one skip the deployment parsing and the
+ * walks of the processes and of the routing zones.
+ */
+struct platform_cache_s {
+    char*        platform;	/* NULL if the cache is empty. */
+    char*        deployment;
+    msg_host_t   master;
+    size_t       worker_count;
+    msg_host_t*  workers;
+    double*      speeds;
+    size_t*      worker_rack;
+    size_t       rack_count;
+};
+
+/**
+ * @brief  A simulation context.
+ *
+ * Holds what the runs of the context share. The state of a run lives in
+ * the globals above while it runs, and is freed at its end.
+ */
+struct mrsg_context_s {
+    struct user_s       user;
+    enum trace_level_e  trace_level;
+    int                 argc;
+    char**              argv;
+    char*               platform;
+    char*               cache_file;	/* Snapshot of the cache, or NULL. */
+    struct platform_cache_s cache;
+};
+
 
+/**
+ * @brief  Create a message header.
+ * @param  kind  The message kind.
+ * @param  data  The payload.
+ * @return The header, freed by destroy_message.
+ */
+message_t new_message (enum sms_kind_e kind, void* data);
+
+/**
+ * @brief  Drop a reference to a task information.
+ * @param  ti  The task information.
+ *
+ * The master and the worker that runs the copy hold a reference each. The
+ * last one destroys the task and returns the information to its pool.
+ */
+void release_task_info (task_info_t ti);
 
 /** 
  * @brief  Send a message/task.
- * @param  str      The message.
- * @param  cpu      The amount of cpu required by the task.
+ * @param  data     The message header or task information.
  * @param  net      The message size in bytes.
- * @param  data     Any data to attatch to the message.
  * @param  mailbox  The destination mailbox alias.
  * @return The MSG status of the operation.
  */
-msg_error_t send (const char* str, double cpu, double net, void* data, const char* mailbox);
+msg_error_t send (void* data, double net, const char* mailbox);
+
+/**
+ * @brief  Send a message/task without waiting for it to be received.
+ * @param  data     The message header or task information.
+ * @param  net      The message size in bytes.
+ * @param  mailbox  The destination mailbox alias.
+ */
+void dsend (void* data, double net, const char* mailbox);
 
 /** 
- * @brief  Send a short message, of size zero.
- * @param  str      The message.
+ * @brief  Send a short message, of size zero and without payload.
+ * @param  kind     The message kind.
  * @param  mailbox  The destination mailbox alias.
  * @return The MSG status of the operation.
  */
-msg_error_t send_sms (const char* str, const char* mailbox);
+msg_error_t send_sms (enum sms_kind_e kind, const char* mailbox);
 
 /** 
  * @brief  Receive a message/task from a mailbox.
@@ -154,24 +469,138 @@ msg_error_t send_sms (const char* str, const char* mailbox);
  */
 msg_error_t receive (msg_task_t* msg, const char* mailbox);
 
+/**
+ * @brief  Get the name of a message kind, used as the MSG task name.
+ * @param  kind  The message kind.
+ * @return The name.
+ */
+const char* message_name (enum sms_kind_e kind);
+
 /** 
- * @brief  Compare the message from a task with a string.
+ * @brief  Get the kind of a message.
+ * @param  msg  The message/task.
+ * @return The kind.
+ */
+enum sms_kind_e message_kind (msg_task_t msg);
+
+/**
+ * @brief  Destroy a message, and its header (but not its payload).
  * @param  msg  The message/task.
- * @param  str  The string to compare with.
- * @return A positive value if matches, zero if doesn't.
  */
-int message_is (msg_task_t msg, const char* str);
+void destroy_message (msg_task_t msg);
+
+/**
+ * @brief  Tell whether a task fits in the free resources of a worker.
+ * @param  free   The free resources.
+ * @param  phase  The phase of the task.
+ */
+int task_fits (resources_t free, enum phase_e phase);
+
+/**
+ * @brief  Take the resources of a task.
+ * @param  free   The free resources.
+ * @param  phase  The phase of the task.
+ */
+void acquire_resources (resources_t free, enum phase_e phase);
+
+/**
+ * @brief  Give back the resources of a task.
+ * @param  free   The free resources.
+ * @param  phase  The phase of the task.
+ */
+void release_resources (resources_t free, enum phase_e phase);
+
+/**
+ * @brief  Return how many tasks of a phase fit in an idle worker.
+ * @param  wid    The worker ID.
+ * @param  phase  MAP or REDUCE.
+ */
+int max_tasks (size_t wid, enum phase_e phase);
 
 /**
  * @brief  Return the maximum of two values.
  */
 int maxval (int a, int b);
 
-size_t map_output_size (size_t mid);
+/**
+ * @brief  Return the simulated time since the start of the run.
+ */
+double sim_clock (void);
+
+/**
+ * @brief  Return the cost of a task.
+ * @param  job    The job.
+ * @param  phase  MAP or REDUCE.
+ * @param  tid    The task ID.
+ * @param  wid    The worker that will run the task.
+ * @return The task cost in flops.
+ *
+ * Includes the combiner and the (de)compression of the intermediate data.
+ */
+double task_cost (job_t job, enum phase_e phase, size_t tid, size_t wid);
+
+/**
+ * @brief  Evaluate the map output of a job for every pair of tasks.
+ * @param  job  The job.
+ */
+void init_map_output (job_t job);
+
+/**
+ * @brief  Free the map output matrix of a job.
+ * @param  job  The job.
+ */
+void free_map_output (job_t job);
 
-size_t reduce_input_size (size_t rid);
+/**
+ * @brief  Return the amount of data a map task emits to a reduce task.
+ * @param  job  The job.
+ * @param  mid  The map task ID.
+ * @param  rid  The reduce task ID.
+ * @return The amount of data in bytes.
+ */
+uint64_t map_output_bytes (job_t job, size_t mid, size_t rid);
 
-enum task_type_e get_task_type (enum phase_e phase, size_t tid, size_t wid);
+/**
+ * @brief  Add the output of a map task to a per-reduce array.
+ * @param  job  The job.
+ * @param  mid  The map task ID.
+ * @param  sum  Array indexed by reduce ID.
+ */
+void add_map_output (job_t job, size_t mid, uint64_t* sum);
+
+uint64_t map_output_size (job_t job, size_t mid);
+
+uint64_t reduce_input_size (job_t job, size_t rid);
+
+enum task_type_e get_task_type (job_t job, enum phase_e phase, size_t tid, size_t wid);
+
+/**
+ * @brief  Create a job that is not submitted yet.
+ * @param  submit_time  The submit time of the job.
+ * @param  chunks       The amount of input chunks (and of map tasks).
+ * @param  reduces      The amount of reduce tasks.
+ * @return The new job, in the default pool.
+ */
+job_t new_job (double submit_time, int chunks, int reduces);
+
+/**
+ * @brief  Find a pool (or queue) by name, and create it if it doesn't exist.
+ * @param  name  The name of the pool.
+ * @return The index of the pool in config.pools.
+ */
+size_t find_pool (const char* name);
+
+/**
+ * @brief  Allocate the task arrays and the data of a submitted job.
+ * @param  job  The job.
+ */
+void init_job (job_t job);
+
+/**
+ * @brief  Free everything allocated by init_job.
+ * @param  job  The job.
+ */
+void free_job (job_t job);
 
 #endif /* !MRSG_COMMON_H */
 
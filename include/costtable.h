@@ -0,0 +1,73 @@
+/* Copyright (c) 2012. MRSG Team. All rights reserved. */
+
+/* This file is part of MRSG.
+
+MRSG is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+MRSG is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef COSTTABLE_H
+#define COSTTABLE_H
+
+#include <stdint.h>
+
+/*
+ * Binary cost table file layout, in host byte order. The file starts with
+ * a cost_table_header_s, and the arrays are found at the byte offsets of
+ * the header, which must be multiples of 8:
+ *
+ * costs   double[(maps + reduces) * max (workers, 1)]
+ *         The cost of every task (flops), maps first. With per-worker
+ *         costs (workers > 0), each task has a row with a cost per worker.
+ *
+ * output  Only with COST_TABLE_OUTPUT. Dense: uint64_t[maps * reduces],
+ *         the bytes every map emits to every reduce, a row per map.
+ *         Sparse (COST_TABLE_SPARSE): the non-zero entries, three arrays
+ *         at output_offset, where map m has entries map_start[m] ..
+ *         map_start[m + 1] - 1, sorted by reduce ID:
+ *             uint64_t  map_start[maps + 1];
+ *             uint64_t  rid[entries];
+ *             uint64_t  bytes[entries];
+ *
+ * A table describes a single job, so it can't be used with a workload
+ * trace, and the job of the configuration must fit in its maps and
+ * reduces. Both are checked when the simulation starts.
+ */
+#define COST_TABLE_MAGIC "MRSGCST1"
+
+/* Header flags. */
+#define COST_TABLE_OUTPUT 0x1
+#define COST_TABLE_SPARSE 0x2
+
+/** @brief  Header of a cost table. */
+struct cost_table_header_s {
+    char      magic[8];
+    uint32_t  header_size;	/* sizeof (struct cost_table_header_s) */
+    uint32_t  flags;
+    uint64_t  maps;
+    uint64_t  reduces;
+    uint64_t  workers;		/* Zero if the costs don't depend on the worker. */
+    uint64_t  entries;		/* Of the sparse output. */
+    uint64_t  cost_offset;
+    uint64_t  output_offset;
+};
+
+/**
+ * @brief  Check that the jobs of the simulation can use the cost table.
+ *
+ * Does nothing if the user functions are not those of a cost table.
+ */
+void check_cost_table (void);
+
+#endif /* !COSTTABLE_H */
+
+// vim: set ts=8 sw=4:
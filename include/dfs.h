@@ -18,25 +18,81 @@ along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
 #ifndef DFS_H
 #define DFS_H
 
-/** @brief  Matrix that maps chunks to workers. */
-char**  chunk_owner;
+/**
+ * @brief  Distribute the chunks (and replicas) of a job to DataNodes.
+ * @param  job  The job.
+ */
+void distribute_data (job_t job);
+
+/**
+ * @brief  Rebuild the replica lists of a job without the lost workers.
+ * @param  job  The job.
+ *
+ * The replicas of a worker are gone while the master considers it lost,
+ * and come back when it recovers.
+ */
+void update_replicas (job_t job);
 
 /**
- * @brief  Distribute chunks (and replicas) to DataNodes.
+ * @brief  Free the chunk replica lists of a job.
+ * @param  job  The job.
  */
-void distribute_data (void);
+void free_data (job_t job);
 
 /**
- * @brief  Default data distribution algorithm.
+ * @brief  Default data distribution algorithm (HDFS default placement).
+ *
+ * The first replica of chunk c goes to worker c mod workers. With more than
+ * one rack, the second replica goes to a random worker in another rack, the
+ * third to another worker of the second replica's rack, and the others to
+ * random workers. With a single rack, replicas are spread with a stride.
+ */
+void default_dfs_f (size_t chunks, size_t workers, int replicas);
+
+/**
+ * @brief  Check if a worker owns a replica of a chunk.
+ * @param  job  The job.
+ * @param  cid  The chunk ID.
+ * @param  wid  The worker ID.
+ * @return 1 if true, 0 if false.
  */
-void default_dfs_f (char** dfs_matrix, size_t chunks, size_t workers, int replicas);
+int chunk_is_local (job_t job, size_t cid, size_t wid);
+
+/**
+ * @brief  Check if a replica of a chunk is in the rack of a worker.
+ * @param  job  The job.
+ * @param  cid  The chunk ID.
+ * @param  wid  The worker ID.
+ * @return 1 if true, 0 if false.
+ */
+int chunk_is_rack_local (job_t job, size_t cid, size_t wid);
+
+/**
+ * @brief  Check if a chunk has a replica on a live worker.
+ * @param  job  The job.
+ * @param  cid  The chunk ID.
+ * @return 1 if true, 0 if false.
+ */
+int chunk_is_available (job_t job, size_t cid);
 
 /**
  * @brief  Choose a random DataNode that owns a specific chunk.
+ * @param  job  The job.
+ * @param  cid  The chunk ID.
+ * @return The ID of the DataNode, or NONE if no live worker has the chunk.
+ */
+size_t find_random_chunk_owner (job_t job, size_t cid);
+
+/**
+ * @brief  Choose the closest DataNode that owns a chunk, for a worker.
+ * @param  job  The job.
  * @param  cid  The chunk ID.
- * @return The ID of the DataNode.
+ * @param  wid  The worker that reads the chunk.
+ * @return The ID of a random owner in the rack of the worker, or of a
+ *         random owner if there is none, or NONE if no live worker has
+ *         the chunk.
  */
-size_t find_random_chunk_owner (int cid);
+size_t find_closest_chunk_owner (job_t job, size_t cid, size_t wid);
 
 /**
  * @brief  DataNode main function.
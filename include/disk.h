@@ -0,0 +1,74 @@
+/* Copyright (c) 2012. MRSG Team. All rights reserved. */
+
+/* This file is part of MRSG.
+
+MRSG is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+MRSG is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
+
+
+#ifndef DISK_H
+#define DISK_H
+
+/* Disk requests are served round-robin, one block at a time. */
+#define DISK_BLOCK_SIZE 4194304
+
+/**
+ * @brief  Process that serves the disk requests of a worker.
+ *
+ * The disk bandwidth is shared among the pending requests, so that
+ * concurrent reads and writes slow each other down. The bandwidths can be
+ * overridden per host with the "disk_read_bandwidth" and
+ * "disk_write_bandwidth" host properties (MB/s).
+ */
+int disk (int argc, char* argv[]);
+
+/**
+ * @brief  Read and write on the local disk, and wait for completion.
+ * @param  read_bytes   The amount of data to read.
+ * @param  write_bytes  The amount of data to write.
+ * @param  mailbox      The mailbox of the calling process, for the reply.
+ *
+ * Does nothing if the disk model is disabled.
+ */
+void disk_io (double read_bytes, double write_bytes, const char* mailbox);
+
+/**
+ * @brief  Read data from the local disk and send it to another process.
+ * @param  kind     The kind of the data message.
+ * @param  bytes    The amount of data.
+ * @param  mailbox  The destination mailbox.
+ *
+ * Returns immediately. The data is sent when the read is done, or at once
+ * if the disk model is disabled.
+ */
+void disk_read_and_send (enum sms_kind_e kind, double bytes, const char* mailbox);
+
+/**
+ * @brief  Charge the spill, sort and merge of a map output to the disk.
+ * @param  job  The job.
+ * @param  mid  The map task ID.
+ * @param  mailbox  The mailbox of the calling process, for the reply.
+ */
+void map_spill (job_t job, size_t mid, const char* mailbox);
+
+/**
+ * @brief  Charge the merge passes of a reduce input to the disk.
+ * @param  job  The job.
+ * @param  rid  The reduce task ID.
+ * @param  mailbox  The mailbox of the calling process, for the reply.
+ */
+void reduce_merge (job_t job, size_t rid, const char* mailbox);
+
+#endif /* !DISK_H */
+
+// vim: set ts=8 sw=4:
@@ -0,0 +1,61 @@
+/* Copyright (c) 2012. MRSG Team. All rights reserved. */
+
+/* This file is part of MRSG.
+
+MRSG is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+MRSG is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef FAILURE_H
+#define FAILURE_H
+
+/*
+ * Worker failure injection.
+ *
+ * A failed worker stops sending heartbeats, its DataNode refuses the
+ * requests and the task copies that run on it are lost. The master learns
+ * about it after config.heartbeat_timeout seconds of silence, or when the
+ * worker comes back and says it restarted (see master.c).
+ */
+
+/**
+ * @brief  Start the failure injection processes, if failures are configured.
+ * @param  host  The host that runs the processes.
+ *
+ * The failures come from config.failure_trace, whose lines are
+ * "<time> <worker host> <downtime>" in seconds (a negative downtime means
+ * the worker never comes back), and from config.failure_mtbf, in which
+ * case every worker fails after exponential times with that mean, and stays
+ * down for exponential times with mean config.failure_mttr.
+ */
+void start_failures (msg_host_t host);
+
+/**
+ * @brief  Stop the failure injection processes.
+ */
+void stop_failures (void);
+
+/**
+ * @brief  Make a worker fail.
+ * @param  wid  The worker ID.
+ */
+void fail_worker (size_t wid);
+
+/**
+ * @brief  Bring a failed worker back, with no tasks and no map output.
+ * @param  wid  The worker ID.
+ */
+void recover_worker (size_t wid);
+
+#endif /* !FAILURE_H */
+
+// vim: set ts=8 sw=4:
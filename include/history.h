@@ -0,0 +1,91 @@
+/* Copyright (c) 2012. MRSG Team. All rights reserved. */
+
+/* This file is part of MRSG.
+
+MRSG is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+MRSG is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "common.h"
+
+/*
+ * Replay of a job history.
+ *
+ * The jobs come from a CSV file with one record per line:
+ *
+ *   job,<submit_time>,<maps>,<reduces>[,<pool>]
+ *   map,<mid>,<seconds>,<output_bytes>[,<host>[;<host>...]]
+ *   reduce,<rid>,<seconds>,<shuffle_bytes>
+ *
+ * The task records follow the record of their job, in any order, and every
+ * task must have one. Submit times are in seconds, and are shifted so that
+ * the first job is submitted at zero. The seconds of a task are its
+ * compute time (e.g. the CPU_MILLISECONDS counter of Hadoop), since the
+ * reads, spills and copies are simulated; they become flops at the average
+ * speed of the workers. The hosts of a map hold the replicas of its input
+ * split. Other records and lines starting with '#' are ignored.
+ *
+ * The file is read a line at a time, and only the task arrays are kept,
+ * so histories larger than the memory can be replayed.
+ */
+
+/** @brief  What a job of the history did. */
+struct history_s {
+    double*      seconds[2];	/* Compute time of each task. */
+    uint64_t*    map_output;	/* Bytes written by each map. */
+    uint64_t     map_output_total;
+    uint64_t*    shuffle;	/* Bytes copied by each reduce. */
+    size_t       split_count;	/* Replicas of the input splits. */
+    size_t*      split_map;
+    msg_host_t*  split_host;	/* NULL if the host is not in the platform. */
+};
+
+/**
+ * @brief  Read the jobs of a history into the workload.
+ * @param  file_name  The history file.
+ */
+void read_job_history (const char* file_name);
+
+/**
+ * @brief  Free the history of a job.
+ * @param  job  The job.
+ */
+void free_history (job_t job);
+
+/**
+ * @brief  Return the cost of a task of the history.
+ * @param  job    The job.
+ * @param  phase  MAP or REDUCE.
+ * @param  tid    The task ID.
+ * @return The task cost in flops.
+ */
+double history_task_cost (job_t job, enum phase_e phase, size_t tid);
+
+/**
+ * @brief  Return the data a map task of the history emits to a reduce task.
+ * @param  job  The job.
+ * @param  mid  The map task ID.
+ * @param  rid  The reduce task ID.
+ * @return The amount of data in bytes.
+ *
+ * The history only tells what each map wrote and what each reduce copied,
+ * so the copy of every reduce is split among the maps in proportion to
+ * their output.
+ */
+uint64_t history_map_output (job_t job, size_t mid, size_t rid);
+
+#endif /* !HISTORY_H */
+
+// vim: set ts=8 sw=4:
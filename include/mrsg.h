@@ -19,6 +19,7 @@ along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
 #define MRSG_H
 
 #include <stdlib.h>
+#include <stdint.h>
 
 /** @brief  Possible execution phases. */
 enum phase_e {
@@ -26,17 +27,152 @@ enum phase_e {
     REDUCE
 };
 
+/** @brief  Tracing levels. */
+enum trace_level_e {
+    MRSG_TRACE_OFF,	/* No tracing at all. */
+    MRSG_TRACE_TASKS,	/* Task events only (default). */
+    MRSG_TRACE_FULL	/* Task events and SimGrid resource tracing. */
+};
+
+/** @brief  Simulator counters of the last run. */
+struct mrsg_perf_s {
+    double    simulated_time;	/* Seconds. */
+    uint64_t  master_iterations;	/* Messages handled by the master loop. */
+    uint64_t  messages;		/* Messages received by all processes. */
+};
+
 void MRSG_init (void);
 
 int MRSG_main (const char* plat, const char* depl, const char* conf);
 
-void MRSG_set_task_cost_f ( double (*f)(enum phase_e phase, size_t tid, size_t wid) );
+/**
+ * @brief  Run the simulation, passing command line options to SimGrid.
+ *
+ * The options (e.g. --cfg=...) are given after the program name in argv,
+ * as received by main. They come after the tracing options of
+ * MRSG_TRACE_FULL, so they can override them.
+ */
+int MRSG_main_args (int argc, char* argv[], const char* plat, const char* depl, const char* conf);
+
+/** @brief  A simulation context. */
+typedef struct mrsg_context_s* mrsg_context_t;
+
+/**
+ * @brief  Create a simulation context.
+ * @param  argc  The command line options for SimGrid, as in MRSG_main_args.
+ * @param  argv  The command line options for SimGrid.
+ * @param  plat  The platform file.
+ * @return The new context.
+ *
+ * The context takes the user functions and the trace level set so far.
+ * Any number of runs, of one or more contexts, can follow each other in a
+ * process. SimGrid is initialized, with the options and the platform of
+ * the context, by the first run; the later runs must use the same platform.
+ */
+mrsg_context_t MRSG_context_create (int argc, char* argv[], const char* plat);
+
+/**
+ * @brief  Run a simulation in a context.
+ * @param  ctx   The context.
+ * @param  depl  The deployment file.
+ * @param  conf  The configuration file.
+ * @return 0 on success, 1 otherwise.
+ *
+ * All the memory of the run is freed when it ends. Times are counted from
+ * the start of each run.
+ */
+int MRSG_context_run (mrsg_context_t ctx, const char* depl, const char* conf);
+
+/**
+ * @brief  Save the workers of the deployment in a file.
+ * @param  ctx   The context.
+ * @param  file  The cache file, or NULL to disable it.
+ *
+ * The runs of a context with the same deployment only parse it once. With
+ * a cache file, the workers, speeds and racks found by the first run are
+ * also saved, and later processes load them instead of parsing the
+ * deployment and walking the platform, while the platform and deployment
+ * files don't change.
+ */
+void MRSG_context_set_platform_cache (mrsg_context_t ctx, const char* file);
+
+/**
+ * @brief  Destroy a simulation context.
+ */
+void MRSG_context_destroy (mrsg_context_t ctx);
+
+/**
+ * @brief  Run a simulation for every point of a parameter grid.
+ * @param  plat   The platform file.
+ * @param  depl   The deployment file.
+ * @param  conf   The base configuration file.
+ * @param  sweep  The grid: one "property value1 value2 ..." line per
+ *                property. Every combination of values is a point.
+ * @param  csv    The output table: the point, its values, the exit status
+ *                and the results of the run (see the results_file key).
+ * @param  procs  Simulations to run at once, or 0 for one per core.
+ * @return 0 if every point succeeded, 1 otherwise.
+ *
+ * Each point runs MRSG_main in its own process, with the base
+ * configuration followed by the values of the point, and without tracing.
+ * The user functions must be set before the call, and MRSG_main must not
+ * have been called. Temporary files are named after csv.
+ */
+int MRSG_sweep (const char* plat, const char* depl, const char* conf, const char* sweep, const char* csv, int procs);
+
+/**
+ * @brief  Get the simulator counters of the last run.
+ */
+void MRSG_get_perf (struct mrsg_perf_s* perf_out);
+
+/**
+ * @brief  Set the tracing level. Must be called before MRSG_main.
+ */
+void MRSG_set_trace_level (enum trace_level_e level);
+
+/**
+ * @brief  Set the function that gives the cost of a task, in FLOPs.
+ *
+ * The job ID lets each job of a workload have its own costs.
+ */
+void MRSG_set_task_cost_f ( double (*f)(size_t jid, enum phase_e phase, size_t tid, size_t wid) );
+
+void MRSG_set_dfs_f ( void (*f)(size_t chunks, size_t workers, int replicas) );
+
+/**
+ * @brief  Place a replica of a chunk on a worker.
+ *
+ * Must only be called from the data distribution function. Repeated
+ * replicas of a chunk on the same worker are ignored.
+ */
+void MRSG_dfs_add_replica (size_t chunk, size_t wid);
 
-void MRSG_set_dfs_f ( void (*f)(char** dfs_matrix, size_t chunks, size_t workers, int replicas) );
+/**
+ * @brief  Set the function that gives the bytes a map task emits to a reduce task.
+ *
+ * The job ID lets each job of a workload have its own map output matrix.
+ */
+void MRSG_set_map_output_f ( uint64_t (*f)(size_t jid, size_t mid, size_t rid) );
 
-void MRSG_set_map_output_f ( int (*f)(size_t mid, size_t rid) );
+/**
+ * @brief  Use a binary cost table as the task cost and map output functions.
+ * @param  file  The table (see costtable.h).
+ *
+ * The file is mapped in memory instead of read, so runs start at once
+ * whatever its size, and the processes of a sweep share its pages. The map
+ * output function is only set if the table has an output matrix. A process
+ * has one table, mapped until the next call or the end of the process.
+ * A table describes a single job, and can't be used with a workload trace.
+ */
+void MRSG_set_cost_table (const char* file);
 
-void MRSG_set_scheduler_f ( size_t (*f)(enum phase_e phase, size_t wid) );
+/**
+ * @brief  Set the function that picks a task of a job for a worker.
+ *
+ * The function is called for each running job, in submission order, until
+ * it returns a task ID. Returning NONE skips the job.
+ */
+void MRSG_set_scheduler_f ( size_t (*f)(size_t jid, enum phase_e phase, size_t wid) );
 
 #endif /* !MRSG_H */
 
@@ -0,0 +1,88 @@
+/* Copyright (c) 2012. MRSG Team. All rights reserved. */
+
+/* This file is part of MRSG.
+
+MRSG is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+MRSG is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef OBJPOOL_H
+#define OBJPOOL_H
+
+#include <stddef.h>
+
+/* Objects allocated at once when a pool runs out. */
+#define OBJ_POOL_SLAB 64
+
+/**
+ * @brief  A free list of fixed-size objects.
+ *
+ * The objects are allocated in slabs of OBJ_POOL_SLAB, and are only
+ * returned to the system when the pool is freed.
+ */
+struct obj_pool_s {
+    const char*  name;
+    size_t       size;		/* Object size in bytes. */
+    void*        free_list;
+    void*        slabs;
+    size_t       gets;		/* Objects handed out. */
+    size_t       slab_count;	/* Allocations made. */
+    size_t       in_use;
+    size_t       peak;
+};
+
+/** @brief  The object pools of the simulator. */
+struct obj_pools_s {
+    struct obj_pool_s  messages;	/* message_s headers. */
+    struct obj_pool_s  task_infos;	/* task_info_s of the task copies. */
+    struct obj_pool_s  shuffles;	/* shuffle_s and their per-worker arrays. */
+};
+
+extern struct obj_pools_s obj_pools;
+
+/**
+ * @brief  Initialize an empty pool.
+ * @param  pool  The pool.
+ * @param  name  The name used in the reports.
+ * @param  size  The object size in bytes.
+ */
+void init_obj_pool (struct obj_pool_s* pool, const char* name, size_t size);
+
+/**
+ * @brief  Free a pool and all its objects.
+ * @param  pool  The pool.
+ */
+void free_obj_pool (struct obj_pool_s* pool);
+
+/**
+ * @brief  Take an object from a pool.
+ * @param  pool  The pool.
+ * @return A zeroed object.
+ */
+void* obj_pool_get (struct obj_pool_s* pool);
+
+/**
+ * @brief  Return an object to its pool.
+ * @param  pool  The pool.
+ * @param  obj   The object.
+ */
+void obj_pool_put (struct obj_pool_s* pool, void* obj);
+
+/**
+ * @brief  Log the counters of a pool.
+ * @param  pool  The pool.
+ */
+void print_obj_pool (struct obj_pool_s* pool);
+
+#endif /* !OBJPOOL_H */
+
+// vim: set ts=8 sw=4:
@@ -0,0 +1,70 @@
+/* Copyright (c) 2012. MRSG Team. All rights reserved. */
+
+/* This file is part of MRSG.
+
+MRSG is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+MRSG is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
+
+
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#define PLATFORM_CACHE_MAGIC "MRSGPLC1"
+
+/**
+ * @brief  Fill a platform cache from the configuration of a run.
+ * @param  cache       The cache.
+ * @param  platform    The platform file.
+ * @param  deployment  The deployment file.
+ * @param  master      The host of the master.
+ *
+ * Must be called after the workers and racks were found.
+ */
+void fill_platform_cache (struct platform_cache_s* cache, const char* platform,
+	const char* deployment, msg_host_t master);
+
+/**
+ * @brief  Check if a cache holds a deployment.
+ * @return 1 if it does, 0 otherwise.
+ */
+int platform_cache_has (struct platform_cache_s* cache, const char* platform, const char* deployment);
+
+/**
+ * @brief  Write a platform cache to a file.
+ *
+ * Hosts are saved by name, along with the modification times of the
+ * platform and deployment files.
+ */
+void save_platform_cache (struct platform_cache_s* cache, const char* file_name);
+
+/**
+ * @brief  Load a platform cache from a file.
+ * @return 1 if the file exists and is still valid for the platform and
+ *         deployment, 0 otherwise (the cache is left empty).
+ */
+int load_platform_cache (struct platform_cache_s* cache, const char* file_name,
+	const char* platform, const char* deployment);
+
+/**
+ * @brief  Start the master and worker processes of a cached deployment.
+ */
+void launch_cached_deployment (struct platform_cache_s* cache);
+
+/**
+ * @brief  Empty a platform cache.
+ */
+void free_platform_cache (struct platform_cache_s* cache);
+
+#endif /* !PLATFORM_H */
+
+// vim: set ts=8 sw=4:
@@ -22,13 +22,84 @@ along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
 
 /**
  * @brief  Chooses a map or reduce task and send it to a worker.
+ * @param  jid    The job id.
  * @param  phase  MAP or REDUCE.
- * @param  wid  Worker id.
+ * @param  wid    Worker id.
  * @return Chosen task id.
  */
-size_t default_scheduler_f (enum phase_e phase, size_t wid);
-size_t choose_default_map_task (size_t wid);
-size_t choose_default_reduce_task (size_t wid);
+size_t default_scheduler_f (size_t jid, enum phase_e phase, size_t wid);
+size_t choose_default_map_task (job_t job, size_t wid);
+size_t choose_default_reduce_task (job_t job, size_t wid);
+
+/**
+ * @brief  Fair Scheduler: pools with minimum shares and weights.
+ *
+ * Pools below their minimum share are served first, then the pool with the
+ * fewest running tasks per weight. Within a pool, the job with the fewest
+ * running tasks is served first.
+ * The choice is made when the first running job is offered, so the
+ * function must be called for the running jobs in submission order, as
+ * the master does.
+ */
+size_t fair_scheduler_f (size_t jid, enum phase_e phase, size_t wid);
+
+/**
+ * @brief  Capacity Scheduler: queues with guaranteed and maximum capacities.
+ *
+ * The queue using the smallest fraction of its capacity is served first,
+ * and a queue never goes above its maximum capacity. Jobs of a queue are
+ * served in submission order.
+ * The calling order requirements of fair_scheduler_f apply.
+ */
+size_t capacity_scheduler_f (size_t jid, enum phase_e phase, size_t wid);
+
+/**
+ * @brief  Count the slots that starved pools may take by preemption.
+ * @param  phase  MAP or REDUCE.
+ * @return The amount of tasks to kill.
+ *
+ * A pool is starved when it stays below its minimum share (or its demand)
+ * for config.preemption_timeout seconds.
+ */
+int fair_preemption_needed (enum phase_e phase);
+
+/**
+ * @brief  Choose the job that loses a task to preemption.
+ * @param  phase  MAP or REDUCE.
+ * @return The job with most running tasks in the pool that is furthest
+ *         above its fair share, or NULL if no pool is above it.
+ */
+job_t fair_preemption_victim (enum phase_e phase);
+
+/**
+ * @brief  Build the map locality index of a job from its chunk owners.
+ * @param  job  The job.
+ */
+void init_locality_index (job_t job);
+
+/**
+ * @brief  Free the map locality index of a job.
+ * @param  job  The job.
+ */
+void free_locality_index (job_t job);
+
+/**
+ * @brief  Rewind the map locality index after the chunk owners changed.
+ * @param  job  The job.
+ */
+void reset_locality_index (job_t job);
+
+/**
+ * @brief  Update the locality index after a map changed its status or copies.
+ * @param  job  The job.
+ * @param  tid  The map task id.
+ */
+void update_locality_index (job_t job, size_t tid);
+
+/**
+ * @brief  Free the memory of the schedulers, at the end of a run.
+ */
+void free_scheduler (void);
 
 #endif /* !SCHEDULING_H */
 
@@ -0,0 +1,96 @@
+/* Copyright (c) 2012. MRSG Team. All rights reserved. */
+
+/* This file is part of MRSG.
+
+MRSG is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+MRSG is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef SPECULATION_H
+#define SPECULATION_H
+
+#include "common.h"
+
+/*
+ * Speculative execution with the LATE policy (Longest Approximate Time to
+ * End, Zaharia et al., OSDI 2008).
+ */
+
+/**
+ * @brief  Allocate the running task sets of the workers.
+ */
+void init_speculation (void);
+
+/**
+ * @brief  Free the running task sets of the workers.
+ */
+void free_speculation (void);
+
+/**
+ * @brief  Add a task copy to the running set of its worker.
+ * @param  ti  The task information of the copy.
+ */
+void task_started (task_info_t ti);
+
+/**
+ * @brief  Stop counting a killed or cancelled copy in the mean rate of its job.
+ * @param  ti  The task information of the copy.
+ *
+ * The copy stays in the running set until it reports.
+ */
+void task_stopped (task_info_t ti);
+
+/**
+ * @brief  Remove a task copy from the running set of its worker.
+ * @param  ti         The task information of the copy.
+ * @param  completed  Whether this copy completed the task.
+ */
+void task_finished (task_info_t ti, int completed);
+
+/**
+ * @brief  Get the running set of a worker.
+ * @param  wid    Worker id.
+ * @param  tasks  Where to store the set, valid until it changes.
+ * @return The amount of task copies in the set.
+ */
+size_t running_tasks (size_t wid, task_info_t** tasks);
+
+/**
+ * @brief  Estimate the progress of the tasks running on a worker.
+ * @param  wid  Worker id.
+ *
+ * Tasks that run for at least SPECULATIVE_LAG seconds, with a progress rate
+ * below config.slow_task_threshold times the average rate of the running
+ * copies of the same job and phase, become speculation candidates
+ * (T_STATUS_TIP_SLOW).
+ */
+void update_task_progress (size_t wid);
+
+/**
+ * @brief  Check if a worker may run a speculative copy.
+ * @param  wid  Worker id.
+ * @return 0 if the speculative cap is reached or the worker is a slow node.
+ */
+int may_speculate (size_t wid);
+
+/**
+ * @brief  Estimated time to end of the running copy of a task.
+ * @param  job    The job.
+ * @param  phase  MAP or REDUCE.
+ * @param  tid    The task id.
+ * @return The time left in seconds.
+ */
+double task_time_left (job_t job, enum phase_e phase, size_t tid);
+
+#endif /* !SPECULATION_H */
+
+// vim: set ts=8 sw=4:
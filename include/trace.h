@@ -0,0 +1,77 @@
+/* Copyright (c) 2012. MRSG Team. All rights reserved. */
+
+/* This file is part of MRSG.
+
+MRSG is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+MRSG is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
+
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "mrsg.h"
+
+/* Task event trace file layout: a header and then fixed-size records, in
+ * host byte order. Use trace2csv to convert it to CSV. */
+#define TRACE_MAGIC "MRSGEVT1"
+#define TRACE_BUFFER_EVENTS 65536
+
+/** @brief  Task events. */
+enum task_action_e {
+    EV_START,
+    EV_END,
+    EV_KILL
+};
+
+/** @brief  Header of the task event trace. */
+struct trace_header_s {
+    char      magic[8];
+    uint32_t  record_size;
+    uint32_t  reserved;
+};
+
+/** @brief  A task event. */
+struct task_event_s {
+    double    time;
+    double    shuffle_end;	/* Only for EV_END. */
+    uint32_t  job;
+    uint32_t  tid;
+    uint32_t  wid;
+    uint16_t  instance;
+    uint8_t   phase;
+    uint8_t   action;
+};
+
+/**
+ * @brief  Start the task event trace.
+ * @param  path  The output file, or NULL to disable the trace.
+ */
+void trace_open (const char* path);
+
+/**
+ * @brief  Record a task event.
+ *
+ * Events are kept in memory and written in blocks of TRACE_BUFFER_EVENTS.
+ */
+void trace_task_event (size_t jid, enum phase_e phase, size_t tid, int instance,
+	size_t wid, enum task_action_e action, double time, double shuffle_end);
+
+/**
+ * @brief  Flush the buffered events and close the trace.
+ */
+void trace_close (void);
+
+#endif /* !TRACE_H */
+
+// vim: set ts=8 sw=4:
@@ -21,10 +21,62 @@ along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
 /* hadoop-config: mapred.max.tracker.failures */
 #define MAXIMUM_WORKER_FAILURES 4
 
+/** @brief  Worker information, attached as the host data. */
 typedef struct w_info_s {
-	size_t  wid;
+	size_t              wid;
+	struct resources_s  freed;	/* Resources freed since the last heartbeat. */
+	int                 failed;	/* Down, by failure injection. */
+	int                 incarnation;	/* Recoveries so far. */
+	int                 restarted;	/* Not yet told to the master. */
+	char                tasktracker[WORKER_MAILBOX_SIZE];
+	char                datanode[WORKER_MAILBOX_SIZE];
+	char                disk[WORKER_MAILBOX_SIZE];
 }* w_info_t;
 
+/** @brief  Copy progress of a reduce task instance. */
+typedef struct shuffle_s {
+    job_t              job;
+    task_info_t        ti;		/* Valid until notified. */
+    size_t             rid;
+    int                refs;
+    int                notified;
+    const char*        parent;	/* Mailbox of the reduce task. */
+    uint64_t           must_copy;
+    uint64_t           total_copied;
+    uint64_t*          copied;	/* Bytes copied from each worker. */
+    char*              state;	/* SRC_IDLE, SRC_QUEUED or SRC_BUSY. */
+    double*            penalty;	/* Current backoff of each worker. */
+    double*            retry_at;
+    size_t*            queue;	/* Workers with output to fetch. */
+    size_t             queue_head;
+    size_t             queue_count;
+    struct shuffle_s*  next;
+}* shuffle_t;
+
+enum source_state_e {
+    SRC_IDLE,
+    SRC_QUEUED,
+    SRC_BUSY
+};
+
+/**
+ * @brief  Allocate the lists of running shuffles of a job.
+ * @param  job  The job.
+ */
+void init_shuffles (job_t job);
+
+/**
+ * @brief  Free the lists of running shuffles of a job.
+ * @param  job  The job.
+ */
+void free_shuffles (job_t job);
+
+/**
+ * @brief  Get the size of a shuffle, including its per-worker arrays.
+ * @return The size in bytes, for the shuffle pool.
+ */
+size_t shuffle_size (void);
+
 /**
  * @brief  Get the ID of a worker.
  * @param  worker  The worker node.
@@ -32,6 +84,13 @@ typedef struct w_info_s {
  */
 size_t get_worker_id (msg_host_t worker);
 
+/**
+ * @brief  Get the information of a worker.
+ * @param  wid  The worker ID.
+ * @return The worker information.
+ */
+w_info_t get_worker_info (size_t wid);
+
 #endif /* !WORKER_H */
 
 // vim: set ts=8 sw=4:
@@ -16,34 +16,74 @@ You should have received a copy of the GNU General Public License
 along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
 
 #include "common.h"
+#include "objpool.h"
+#include "history.h"
 
 XBT_LOG_EXTERNAL_DEFAULT_CATEGORY (msg_test);
 
-msg_error_t send (const char* str, double cpu, double net, void* data, const char* mailbox)
+static const char* message_names[] = {
+    "SMS-GC", "SMS-GIP", "SMS-HB", "SMS-T", "SMS-TD", "SMS-F", "SMS-S", "SMS-D",
+    "DATA-C", "DATA-IP", "DATA-L"
+};
+
+message_t new_message (enum sms_kind_e kind, void* data)
 {
-    msg_error_t  status;
-    msg_task_t   msg = NULL;
+    message_t  m;
+
+    m = (message_t) obj_pool_get (&obj_pools.messages);
+    m->kind = kind;
+    m->data = data;
+
+    return m;
+}
+
+const char* message_name (enum sms_kind_e kind)
+{
+    return message_names[kind];
+}
+
+void release_task_info (task_info_t ti)
+{
+    if (--ti->refs > 0)
+	return;
+
+    MSG_task_destroy (ti->task);
+    obj_pool_put (&obj_pools.task_infos, ti);
+}
+
+msg_error_t send (void* data, double net, const char* mailbox)
+{
+    enum sms_kind_e  kind = *(enum sms_kind_e*) data;
+    msg_error_t      status;
+    msg_task_t       msg = NULL;
 
-    msg = MSG_task_create (str, cpu, net, data);
+    msg = MSG_task_create (message_names[kind], 0.0, net, data);
 
 #ifdef VERBOSE
-    if (!message_is (msg, SMS_HEARTBEAT))
-	    XBT_INFO ("TX (%s): %s", mailbox, str);
+    if (kind != SMS_HEARTBEAT)
+	    XBT_INFO ("TX (%s): %s", mailbox, message_names[kind]);
 #endif
 
     status = MSG_task_send (msg, mailbox);
 
 #ifdef VERBOSE
     if (status != MSG_OK)
-	XBT_INFO ("ERROR %d SENDING MESSAGE: %s", status, str);
+	XBT_INFO ("ERROR %d SENDING MESSAGE: %s", status, message_names[kind]);
 #endif
 
     return status;
 }
 
-msg_error_t send_sms (const char* str, const char* mailbox)
+void dsend (void* data, double net, const char* mailbox)
 {
-    return send (str, 0.0, 0.0, NULL, mailbox);
+    enum sms_kind_e  kind = *(enum sms_kind_e*) data;
+
+    MSG_task_dsend (MSG_task_create (message_names[kind], 0.0, net, data), mailbox, NULL);
+}
+
+msg_error_t send_sms (enum sms_kind_e kind, const char* mailbox)
+{
+    return send (new_message (kind, NULL), 0.0, mailbox);
 }
 
 msg_error_t receive (msg_task_t* msg, const char* mailbox)
@@ -51,6 +91,7 @@ msg_error_t receive (msg_task_t* msg, const char* mailbox)
     msg_error_t  status;
 
     status = MSG_task_receive (msg, mailbox);
+    perf.messages++;
 
 #ifdef VERBOSE
     if (status != MSG_OK)
@@ -60,12 +101,65 @@ msg_error_t receive (msg_task_t* msg, const char* mailbox)
     return status;
 }
 
-int message_is (msg_task_t msg, const char* str)
+enum sms_kind_e message_kind (msg_task_t msg)
 {
-    if (strcmp (MSG_task_get_name (msg), str) == 0)
-	return 1;
+    return *(enum sms_kind_e*) MSG_task_get_data (msg);
+}
 
-    return 0;
+void destroy_message (msg_task_t msg)
+{
+    enum sms_kind_e  kind = message_kind (msg);
+
+    if (kind != SMS_TASK && kind != SMS_TASK_DONE)
+	obj_pool_put (&obj_pools.messages, MSG_task_get_data (msg));
+
+    MSG_task_destroy (msg);
+}
+
+int task_fits (resources_t free, enum phase_e phase)
+{
+    int  r;
+
+    for (r = 0; r < RESOURCES; r++)
+	if (free->amount[r] < config.demand[phase].amount[r])
+	    return 0;
+
+    return 1;
+}
+
+void acquire_resources (resources_t free, enum phase_e phase)
+{
+    int  r;
+
+    for (r = 0; r < RESOURCES; r++)
+	free->amount[r] -= config.demand[phase].amount[r];
+}
+
+void release_resources (resources_t free, enum phase_e phase)
+{
+    int  r;
+
+    for (r = 0; r < RESOURCES; r++)
+	free->amount[r] += config.demand[phase].amount[r];
+}
+
+int max_tasks (size_t wid, enum phase_e phase)
+{
+    int  r;
+    int  tasks = -1;
+    int  fit;
+
+    for (r = 0; r < RESOURCES; r++)
+    {
+	if (config.demand[phase].amount[r] > 0)
+	{
+	    fit = config.capacity[wid].amount[r] / config.demand[phase].amount[r];
+	    if (tasks < 0 || fit < tasks)
+		tasks = fit;
+	}
+    }
+
+    return tasks;
 }
 
 int maxval (int a, int b)
@@ -76,40 +170,199 @@ int maxval (int a, int b)
     return a;
 }
 
+double sim_clock (void)
+{
+    return MSG_get_clock () - workload.start_clock;
+}
+
+double task_cost (job_t job, enum phase_e phase, size_t tid, size_t wid)
+{
+    double  cost;
+    double  plain;
+
+    /* The measured times already include the combiner and the codec. */
+    if (job->history != NULL)
+	return history_task_cost (job, phase, tid);
+
+    if (job->has_profile)
+	cost = job->profile_cost[phase];
+    else
+	cost = user.task_cost_f (job->id, phase, tid, wid);
+
+    if (phase == MAP)
+    {
+	/* The stored output is combined and compressed. */
+	plain = map_output_size (job, tid) / config.compress_ratio;
+	cost += config.combiner_cost * plain / config.combiner_ratio;
+	if (config.compress_ratio < 1.0)
+	    cost += plain / config.compress_speed * config.grid_average_speed;
+    }
+    else if (config.compress_ratio < 1.0)
+    {
+	plain = reduce_input_size (job, tid) / config.compress_ratio;
+	cost += plain / config.decompress_speed * config.grid_average_speed;
+    }
+
+    return cost;
+}
+
+void init_map_output (job_t job)
+{
+    size_t           count = 0;
+    size_t           i;
+    size_t           maps = job->amount_of_tasks[MAP];
+    size_t           reduces = job->amount_of_tasks[REDUCE];
+    size_t           mid;
+    size_t           rid;
+    struct output_s* output = &job->output;
+    uint64_t         bytes;
+    uint64_t*        dense;
+    double           shrink;
+
+    output->map_total = xbt_new0 (uint64_t, maps);
+    output->reduce_total = xbt_new0 (uint64_t, reduces);
+
+    /* The matrix holds the bytes that are spilled and shuffled. */
+    shrink = config.combiner_ratio * config.compress_ratio;
+
+    /* Fill the dense matrix, which is the common case: every map usually
+     * sends to every reduce. */
+    dense = xbt_new (uint64_t, maps * reduces);
+
+    for (mid = 0; mid < maps; mid++)
+    {
+	for (rid = 0; rid < reduces; rid++)
+	{
+	    /* The history has the bytes that were actually copied. */
+	    if (job->history != NULL)
+		bytes = history_map_output (job, mid, rid);
+	    else if (job->has_profile)
+		bytes = job->profile_output;
+	    else
+		bytes = user.map_output_f (job->id, mid, rid);
+
+	    if (shrink < 1.0 && job->history == NULL)
+		bytes = (uint64_t) (bytes * shrink + 0.5);
+
+	    dense[mid * reduces + rid] = bytes;
+	    if (bytes == 0)
+		continue;
+
+	    count++;
+	    output->map_total[mid] += bytes;
+	    output->reduce_total[rid] += bytes;
+	    output->total += bytes;
+	}
+    }
+
+    /* The sparse form needs two words per entry. */
+    output->sparse = (2 * count < maps * reduces);
+
+    if (!output->sparse)
+    {
+	output->bytes = dense;
+	return;
+    }
+
+    output->map_start = xbt_new (size_t, maps + 1);
+    output->bytes = xbt_new (uint64_t, count + 1);
+    output->rid = xbt_new (size_t, count + 1);
+
+    for (count = 0, mid = 0; mid < maps; mid++)
+    {
+	output->map_start[mid] = count;
+	for (rid = 0, i = mid * reduces; rid < reduces; rid++, i++)
+	{
+	    if (dense[i] == 0)
+		continue;
+
+	    output->bytes[count] = dense[i];
+	    output->rid[count] = rid;
+	    count++;
+	}
+    }
+    output->map_start[maps] = count;
+
+    xbt_free (dense);
+}
+
+void free_map_output (job_t job)
+{
+    xbt_free_ref (&job->output.bytes);
+    xbt_free_ref (&job->output.rid);
+    xbt_free_ref (&job->output.map_start);
+    xbt_free_ref (&job->output.map_total);
+    xbt_free_ref (&job->output.reduce_total);
+}
+
+uint64_t map_output_bytes (job_t job, size_t mid, size_t rid)
+{
+    size_t           low;
+    size_t           high;
+    size_t           i;
+    struct output_s* output = &job->output;
+
+    if (!output->sparse)
+	return output->bytes[mid * job->amount_of_tasks[REDUCE] + rid];
+
+    low = output->map_start[mid];
+    high = output->map_start[mid + 1];
+    while (low < high)
+    {
+	i = low + (high - low) / 2;
+	if (output->rid[i] < rid)
+	    low = i + 1;
+	else
+	    high = i;
+    }
+
+    if (low < output->map_start[mid + 1] && output->rid[low] == rid)
+	return output->bytes[low];
+
+    return 0;
+}
+
+void add_map_output (job_t job, size_t mid, uint64_t* sum)
+{
+    size_t           i;
+    size_t           rid;
+    size_t           reduces = job->amount_of_tasks[REDUCE];
+    struct output_s* output = &job->output;
+    uint64_t*        row;
+
+    if (output->sparse)
+    {
+	for (i = output->map_start[mid]; i < output->map_start[mid + 1]; i++)
+	    sum[output->rid[i]] += output->bytes[i];
+    }
+    else
+    {
+	row = &output->bytes[mid * reduces];
+	for (rid = 0; rid < reduces; rid++)
+	    sum[rid] += row[rid];
+    }
+}
+
 /**
  * @brief  Return the output size of a map task.
+ * @param  job  The job.
  * @param  mid  The map task ID.
  * @return The task output size in bytes.
  */
-size_t map_output_size (size_t mid)
+uint64_t map_output_size (job_t job, size_t mid)
 {
-    size_t  rid;
-    size_t  sum = 0;
-
-    for (rid = 0; rid < config.amount_of_tasks[REDUCE]; rid++)
-    {
-	sum += user.map_output_f (mid, rid);
-    }
-
-    return sum;
+    return job->output.map_total[mid];
 }
 
 /**
  * @brief  Return the input size of a reduce task.
+ * @param  job  The job.
  * @param  rid  The reduce task ID.
  * @return The task input size in bytes.
  */
-size_t reduce_input_size (size_t rid)
+uint64_t reduce_input_size (job_t job, size_t rid)
 {
-    size_t  mid;
-    size_t  sum = 0;
-
-    for (mid = 0; mid < config.amount_of_tasks[MAP]; mid++)
-    {
-	sum += user.map_output_f (mid, rid);
-    }
-
-    return sum;
+    return job->output.reduce_total[rid];
 }
 
 // vim: set ts=8 sw=4:
@@ -0,0 +1,224 @@
+/* Copyright (c) 2012. MRSG Team. All rights reserved. */
+
+/* This file is part of MRSG.
+
+MRSG is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+MRSG is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "common.h"
+#include "costtable.h"
+
+XBT_LOG_EXTERNAL_DEFAULT_CATEGORY (msg_test);
+
+static double table_task_cost_f (size_t jid, enum phase_e phase, size_t tid, size_t wid);
+static uint64_t table_map_output_f (size_t jid, size_t mid, size_t rid);
+static void check_section (uint64_t offset, uint64_t count, const char* file);
+static uint64_t count_add (uint64_t a, uint64_t b, const char* file);
+static uint64_t count_mul (uint64_t a, uint64_t b, const char* file);
+
+/** @brief  The mapped cost table. */
+static struct {
+    void*                              map;	/* NULL if there is none. */
+    size_t                             size;
+    const struct cost_table_header_s*  header;
+    const double*                      cost;
+    const uint64_t*                    output;	/* Dense matrix or sparse bytes. */
+    const uint64_t*                    map_start;
+    const uint64_t*                    rid;
+} table;
+
+
+void MRSG_set_cost_table (const char* file)
+{
+    int                                fd;
+    struct stat                        st;
+    const struct cost_table_header_s*  header;
+    uint64_t                           count;
+
+    fd = open (file, O_RDONLY);
+    xbt_assert (fd >= 0, "Error reading cost table: %s", file);
+    xbt_assert (fstat (fd, &st) == 0 && st.st_size >= sizeof (struct cost_table_header_s),
+	    "%s is not a cost table", file);
+
+    if (table.map != NULL)
+	munmap (table.map, table.size);
+
+    /* Pages are read on demand, and shared by the processes that map it. */
+    table.size = st.st_size;
+    table.map = mmap (NULL, table.size, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    xbt_assert (table.map != MAP_FAILED, "Error mapping cost table: %s", file);
+
+    header = (const struct cost_table_header_s*) table.map;
+    xbt_assert (memcmp (header->magic, COST_TABLE_MAGIC, sizeof (header->magic)) == 0
+	    && header->header_size == sizeof (struct cost_table_header_s),
+	    "%s is not a cost table of this version", file);
+    table.header = header;
+
+    count = count_mul (count_add (header->maps, header->reduces, file),
+	    (header->workers > 0 ? header->workers : 1), file);
+    check_section (header->cost_offset, count, file);
+    table.cost = (const double*) ((const char*) table.map + header->cost_offset);
+
+    table.output = NULL;
+    table.map_start = NULL;
+    table.rid = NULL;
+    if ((header->flags & COST_TABLE_OUTPUT) && (header->flags & COST_TABLE_SPARSE))
+    {
+	count = count_add (count_add (header->maps, 1, file),
+		count_mul (header->entries, 2, file), file);
+	check_section (header->output_offset, count, file);
+	table.map_start = (const uint64_t*) ((const char*) table.map + header->output_offset);
+	table.rid = table.map_start + header->maps + 1;
+	table.output = table.rid + header->entries;
+    }
+    else if (header->flags & COST_TABLE_OUTPUT)
+    {
+	check_section (header->output_offset, count_mul (header->maps, header->reduces, file), file);
+	table.output = (const uint64_t*) ((const char*) table.map + header->output_offset);
+    }
+
+    user.task_cost_f = table_task_cost_f;
+    if (header->flags & COST_TABLE_OUTPUT)
+	user.map_output_f = table_map_output_f;
+}
+
+void check_cost_table (void)
+{
+    const struct cost_table_header_s* header = table.header;
+    job_t                             job;
+    size_t                            jid;
+
+    if (table.map == NULL
+	    || (user.task_cost_f != table_task_cost_f && user.map_output_f != table_map_output_f))
+	return;
+
+    xbt_assert (config.workload_trace == NULL,
+	    "A cost table describes a single job, and can't be used with a workload trace");
+
+    for (jid = 0; jid < workload.job_count; jid++)
+    {
+	job = workload.jobs[jid];
+	if (job->has_profile || job->history != NULL)
+	    continue;
+
+	xbt_assert (job->amount_of_tasks[MAP] <= header->maps
+		&& job->amount_of_tasks[REDUCE] <= header->reduces,
+		"Job %zu has more maps or reduces than the cost table", job->id);
+    }
+}
+
+/**
+ * @brief  Task cost function of the cost table.
+ */
+static double table_task_cost_f (size_t jid, enum phase_e phase, size_t tid, size_t wid)
+{
+    const struct cost_table_header_s* header = table.header;
+    uint64_t                          row;
+
+    xbt_assert (tid < (phase == MAP ? header->maps : header->reduces),
+	    "The cost table has no %s task %zu", (phase == MAP ? "map" : "reduce"), tid);
+
+    row = (phase == MAP ? tid : header->maps + tid);
+
+    if (header->workers == 0)
+	return table.cost[row];
+
+    xbt_assert (wid < header->workers, "The cost table has no costs for worker %zu", wid);
+
+    return table.cost[row * header->workers + wid];
+}
+
+/**
+ * @brief  Map output function of the cost table.
+ */
+static uint64_t table_map_output_f (size_t jid, size_t mid, size_t rid)
+{
+    const struct cost_table_header_s* header = table.header;
+    uint64_t                          first;
+    uint64_t                          last;
+    uint64_t                          middle;
+
+    xbt_assert (mid < header->maps && rid < header->reduces,
+	    "The cost table has no output from map %zu to reduce %zu", mid, rid);
+
+    if (table.map_start == NULL)
+	return table.output[mid * header->reduces + rid];
+
+    first = table.map_start[mid];
+    last = table.map_start[mid + 1];
+    xbt_assert (first <= last && last <= header->entries, "Invalid output of map %zu in the cost table", mid);
+
+    /* Binary search of the reduce in the row of the map. */
+    while (first < last)
+    {
+	middle = first + (last - first) / 2;
+	if (table.rid[middle] < rid)
+	    first = middle + 1;
+	else
+	    last = middle;
+    }
+
+    if (first < table.map_start[mid + 1] && table.rid[first] == rid)
+	return table.output[first];
+
+    return 0;
+}
+
+/**
+ * @brief  Check that a section of the cost table is inside the file.
+ * @param  offset  The start of the section.
+ * @param  count   The 8-byte values of the section.
+ * @param  file    The table file.
+ */
+static void check_section (uint64_t offset, uint64_t count, const char* file)
+{
+    xbt_assert (offset % 8 == 0 && offset >= sizeof (struct cost_table_header_s)
+	    && offset <= table.size && count <= (table.size - offset) / 8,
+	    "Invalid section in cost table %s", file);
+}
+
+/**
+ * @brief  Add two counts of the cost table header.
+ * @param  a     The first count.
+ * @param  b     The second count.
+ * @param  file  The table file.
+ * @return The sum, which must fit in 64 bits.
+ */
+static uint64_t count_add (uint64_t a, uint64_t b, const char* file)
+{
+    xbt_assert (a <= UINT64_MAX - b, "Invalid sizes in cost table %s", file);
+
+    return a + b;
+}
+
+/**
+ * @brief  Multiply two counts of the cost table header.
+ * @param  a     The first count.
+ * @param  b     The second count.
+ * @param  file  The table file.
+ * @return The product, which must fit in 64 bits.
+ */
+static uint64_t count_mul (uint64_t a, uint64_t b, const char* file)
+{
+    xbt_assert (b == 0 || a <= UINT64_MAX / b, "Invalid sizes in cost table %s", file);
+
+    return a * b;
+}
+
+// vim: set ts=8 sw=4:
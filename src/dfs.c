@@ -19,105 +19,490 @@ along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
 #include "common.h"
 #include "worker.h"
 #include "dfs.h"
+#include "disk.h"
+#include "history.h"
 
 XBT_LOG_EXTERNAL_DEFAULT_CATEGORY (msg_test);
 
 
+static void build_chunk_owner (job_t job);
+static void free_chunk_owner (struct chunk_owner_s* chunk_owner);
 static void send_data (msg_task_t msg);
+static size_t random_worker_not_in (size_t* used, int count, size_t rack);
+static void replay_splits (job_t job);
 
+/* Replicas placed by the distribution function, in call order. */
+static size_t*  new_chunk;
+static size_t*  new_owner;
+static size_t   new_count;
+static size_t   new_capacity;
+static job_t    building;	/* The job being distributed. */
 
-void distribute_data (void)
+
+void distribute_data (job_t job)
 {
-    size_t  chunk;
+    size_t  wid;
+
+    new_count = 0;
+    new_capacity = job->chunk_count * config.chunk_replicas;
+    new_chunk = xbt_new (size_t, new_capacity);
+    new_owner = xbt_new (size_t, new_capacity);
+
+    /* Call the distribution function. */
+    building = job;
+    user.dfs_f (job->chunk_count, config.number_of_workers, config.chunk_replicas);
+    if (job->history != NULL)
+	replay_splits (job);
+    building = NULL;
+
+    build_chunk_owner (job);
+
+    /* The replicas on lost workers are not available yet. */
+    for (wid = 0; wid < config.number_of_workers; wid++)
+    {
+	if (workload.lost[wid])
+	{
+	    update_replicas (job);
+	    break;
+	}
+    }
+}
 
-    /* Allocate memory for the mapping matrix. */
-    chunk_owner = xbt_new (char*, config.chunk_count);
-    for (chunk = 0; chunk < config.chunk_count; chunk++)
+void update_replicas (job_t job)
+{
+    size_t                chunk;
+    size_t                i;
+    struct chunk_owner_s* chunk_owner = &job->chunk_owner;
+    struct chunk_owner_s* replicas = &job->replicas;
+
+    /* The first time, keep the complete lists. */
+    if (replicas->owner == NULL)
     {
-	chunk_owner[chunk] = xbt_new0 (char, config.number_of_workers);
+	replicas->owner = chunk_owner->owner;
+	replicas->chunk_start = chunk_owner->chunk_start;
+	chunk_owner->owner = NULL;
+	chunk_owner->chunk_start = NULL;
     }
+    free_chunk_owner (chunk_owner);
 
-    /* Call the distribution function. */
-    user.dfs_f (chunk_owner, config.chunk_count, config.number_of_workers, config.chunk_replicas);
+    new_count = 0;
+    new_capacity = replicas->chunk_start[job->chunk_count] + 1;
+    new_chunk = xbt_new (size_t, new_capacity);
+    new_owner = xbt_new (size_t, new_capacity);
+
+    for (chunk = 0; chunk < job->chunk_count; chunk++)
+    {
+	for (i = replicas->chunk_start[chunk]; i < replicas->chunk_start[chunk + 1]; i++)
+	{
+	    if (!workload.lost[replicas->owner[i]])
+	    {
+		new_chunk[new_count] = chunk;
+		new_owner[new_count] = replicas->owner[i];
+		new_count++;
+	    }
+	}
+    }
+
+    build_chunk_owner (job);
+}
+
+void free_data (job_t job)
+{
+    free_chunk_owner (&job->chunk_owner);
+    free_chunk_owner (&job->replicas);
+}
+
+/**
+ * @brief  Build the replica lists of a job from the placed replicas.
+ * @param  job  The job.
+ *
+ * Takes the replicas in new_chunk and new_owner, and frees them.
+ */
+static void build_chunk_owner (job_t job)
+{
+    size_t                chunk;
+    size_t                i;
+    size_t                rack;
+    size_t                wid;
+    size_t*               sorted;
+    size_t*               next;
+    size_t*               seen;
+    struct chunk_owner_s* chunk_owner = &job->chunk_owner;
+
+    /* Group the replicas by chunk (counting sort). */
+    next = xbt_new0 (size_t, job->chunk_count + 1);
+    for (i = 0; i < new_count; i++)
+	next[new_chunk[i] + 1]++;
+    for (chunk = 0; chunk < job->chunk_count; chunk++)
+	next[chunk + 1] += next[chunk];
+
+    sorted = xbt_new (size_t, new_count);
+    for (i = 0; i < new_count; i++)
+	sorted[next[new_chunk[i]]++] = new_owner[i];
+
+    /* Drop repeated owners and build the chunk lists. */
+    seen = xbt_new0 (size_t, config.number_of_workers);
+    chunk_owner->owner = xbt_new (size_t, new_count);
+    chunk_owner->chunk_start = xbt_new (size_t, job->chunk_count + 1);
+    chunk_owner->chunk_start[0] = 0;
+    i = 0;
+    for (chunk = 0; chunk < job->chunk_count; chunk++)
+    {
+	chunk_owner->chunk_start[chunk + 1] = chunk_owner->chunk_start[chunk];
+	for (; i < next[chunk]; i++)
+	{
+	    wid = sorted[i];
+	    if (seen[wid] != chunk + 1)
+	    {
+		seen[wid] = chunk + 1;
+		chunk_owner->owner[chunk_owner->chunk_start[chunk + 1]++] = wid;
+	    }
+	}
+    }
+
+    xbt_free_ref (&sorted);
+    xbt_free_ref (&next);
+    xbt_free_ref (&seen);
+    xbt_free_ref (&new_chunk);
+    xbt_free_ref (&new_owner);
+
+    /* Build the inverse lists, with the chunks of each worker in order. */
+    chunk_owner->worker_start = xbt_new0 (size_t, config.number_of_workers + 1);
+    for (i = 0; i < chunk_owner->chunk_start[job->chunk_count]; i++)
+	chunk_owner->worker_start[chunk_owner->owner[i] + 1]++;
+    for (wid = 0; wid < config.number_of_workers; wid++)
+	chunk_owner->worker_start[wid + 1] += chunk_owner->worker_start[wid];
+
+    next = xbt_new (size_t, config.number_of_workers);
+    for (wid = 0; wid < config.number_of_workers; wid++)
+	next[wid] = chunk_owner->worker_start[wid];
+
+    chunk_owner->chunk = xbt_new (size_t, chunk_owner->chunk_start[job->chunk_count]);
+    for (chunk = 0; chunk < job->chunk_count; chunk++)
+	for (i = chunk_owner->chunk_start[chunk]; i < chunk_owner->chunk_start[chunk + 1]; i++)
+	    chunk_owner->chunk[next[chunk_owner->owner[i]]++] = chunk;
+
+    xbt_free_ref (&next);
+
+    /* Build the chunk lists of the racks, without repeated chunks. */
+    seen = xbt_new0 (size_t, config.rack_count);
+    chunk_owner->rack_start = xbt_new0 (size_t, config.rack_count + 1);
+    for (chunk = 0; chunk < job->chunk_count; chunk++)
+    {
+	for (i = chunk_owner->chunk_start[chunk]; i < chunk_owner->chunk_start[chunk + 1]; i++)
+	{
+	    rack = config.worker_rack[chunk_owner->owner[i]];
+	    if (seen[rack] != chunk + 1)
+	    {
+		seen[rack] = chunk + 1;
+		chunk_owner->rack_start[rack + 1]++;
+	    }
+	}
+    }
+    for (rack = 0; rack < config.rack_count; rack++)
+	chunk_owner->rack_start[rack + 1] += chunk_owner->rack_start[rack];
+
+    next = xbt_new (size_t, config.rack_count);
+    for (rack = 0; rack < config.rack_count; rack++)
+    {
+	next[rack] = chunk_owner->rack_start[rack];
+	seen[rack] = 0;
+    }
+
+    chunk_owner->rack_chunk = xbt_new (size_t, chunk_owner->rack_start[config.rack_count]);
+    for (chunk = 0; chunk < job->chunk_count; chunk++)
+    {
+	for (i = chunk_owner->chunk_start[chunk]; i < chunk_owner->chunk_start[chunk + 1]; i++)
+	{
+	    rack = config.worker_rack[chunk_owner->owner[i]];
+	    if (seen[rack] != chunk + 1)
+	    {
+		seen[rack] = chunk + 1;
+		chunk_owner->rack_chunk[next[rack]++] = chunk;
+	    }
+	}
+    }
+
+    xbt_free_ref (&next);
+    xbt_free_ref (&seen);
+}
+
+/**
+ * @brief  Put the input splits of a replayed job where the history says.
+ * @param  job  The job.
+ *
+ * The replicas placed by the distribution function are only kept for the
+ * chunks whose hosts are not workers of the platform.
+ */
+static void replay_splits (job_t job)
+{
+    char*                 replayed;
+    msg_host_t            host;
+    size_t                i;
+    size_t                kept = 0;
+    struct history_s*     history = job->history;
+    w_info_t              wi;
+
+    replayed = xbt_new0 (char, job->chunk_count);
+    for (i = 0; i < history->split_count; i++)
+    {
+	host = history->split_host[i];
+	if (host != NULL && MSG_host_get_data (host) != NULL)
+	    replayed[history->split_map[i]] = 1;
+    }
+
+    for (i = 0; i < new_count; i++)
+    {
+	if (!replayed[new_chunk[i]])
+	{
+	    new_chunk[kept] = new_chunk[i];
+	    new_owner[kept] = new_owner[i];
+	    kept++;
+	}
+    }
+    new_count = kept;
+
+    for (i = 0; i < history->split_count; i++)
+    {
+	host = history->split_host[i];
+	if (host == NULL)
+	    continue;
+	wi = (w_info_t) MSG_host_get_data (host);
+	if (wi != NULL)
+	    MRSG_dfs_add_replica (history->split_map[i], wi->wid);
+    }
+
+    xbt_free_ref (&replayed);
+}
+
+/**
+ * @brief  Free the replica lists.
+ * @param  chunk_owner  The lists.
+ */
+static void free_chunk_owner (struct chunk_owner_s* chunk_owner)
+{
+    xbt_free_ref (&chunk_owner->owner);
+    xbt_free_ref (&chunk_owner->chunk_start);
+    xbt_free_ref (&chunk_owner->chunk);
+    xbt_free_ref (&chunk_owner->worker_start);
+    xbt_free_ref (&chunk_owner->rack_chunk);
+    xbt_free_ref (&chunk_owner->rack_start);
+}
+
+void MRSG_dfs_add_replica (size_t chunk, size_t wid)
+{
+    xbt_assert (building != NULL, "Replicas can only be added by the distribution function");
+    xbt_assert (chunk < building->chunk_count, "Invalid chunk %zu", chunk);
+    xbt_assert (wid < config.number_of_workers, "Invalid worker %zu", wid);
+
+    if (new_count == new_capacity)
+    {
+	new_capacity = 2 * new_capacity + 1;
+	new_chunk = xbt_realloc (new_chunk, new_capacity * sizeof (size_t));
+	new_owner = xbt_realloc (new_owner, new_capacity * sizeof (size_t));
+    }
+
+    new_chunk[new_count] = chunk;
+    new_owner[new_count] = wid;
+    new_count++;
 }
 
-void default_dfs_f (char** dfs_matrix, size_t chunks, size_t workers, int replicas)
+void default_dfs_f (size_t chunks, size_t workers, int replicas)
 {
     int     r;
     size_t  chunk;
+    size_t  first;
     size_t  owner;
+    size_t  rack;
+    size_t  rack_size;
+    size_t* used;
 
-    if (config.chunk_replicas >= config.number_of_workers)
+    if (replicas >= workers)
     {
 	/* All workers own every chunk. */
-	for (chunk = 0; chunk < config.chunk_count; chunk++)
+	for (chunk = 0; chunk < chunks; chunk++)
 	{
-	    for (owner = 0; owner < config.number_of_workers; owner++)
+	    for (owner = 0; owner < workers; owner++)
 	    {
-		chunk_owner[chunk][owner] = 1;
+		MRSG_dfs_add_replica (chunk, owner);
 	    }
 	}
     }
-    else
+    else if (config.rack_count < 2)
     {
 	/* Ok, it's a typical distribution. */
-	for (chunk = 0; chunk < config.chunk_count; chunk++)
+	for (chunk = 0; chunk < chunks; chunk++)
 	{
-	    for (r = 0; r < config.chunk_replicas; r++)
+	    for (r = 0; r < replicas; r++)
 	    {
-		owner = ((chunk % config.number_of_workers)
-			+ ((config.number_of_workers / config.chunk_replicas) * r)
-			) % config.number_of_workers;
+		owner = ((chunk % workers) + ((workers / replicas) * r)) % workers;
+
+		MRSG_dfs_add_replica (chunk, owner);
+	    }
+	}
+    }
+    else
+    {
+	used = xbt_new (size_t, replicas);
+
+	for (chunk = 0; chunk < chunks; chunk++)
+	{
+	    /* First replica: the "writer". */
+	    used[0] = chunk % workers;
 
-		chunk_owner[chunk][owner] = 1;
+	    for (r = 1; r < replicas; r++)
+	    {
+		if (r == 1)
+		{
+		    /* Second replica: off the rack of the first one. */
+		    used[r] = random_worker_not_in (used, r, config.worker_rack[used[0]]);
+		}
+		else if (r == 2)
+		{
+		    /* Third replica: in the rack of the second one, if it has room. */
+		    rack = config.worker_rack[used[1]];
+		    rack_size = config.rack_start[rack + 1] - config.rack_start[rack];
+		    if (rack_size > 1)
+		    {
+			first = config.rack_start[rack] + rand () % rack_size;
+			do
+			{
+			    owner = config.rack_worker[first];
+			    first = (first + 1 < config.rack_start[rack + 1] ? first + 1 : config.rack_start[rack]);
+			} while (owner == used[1]);
+			used[r] = owner;
+		    }
+		    else
+		    {
+			used[r] = random_worker_not_in (used, r, NONE);
+		    }
+		}
+		else
+		{
+		    used[r] = random_worker_not_in (used, r, NONE);
+		}
 	    }
+
+	    for (r = 0; r < replicas; r++)
+		MRSG_dfs_add_replica (chunk, used[r]);
 	}
+
+	xbt_free_ref (&used);
     }
 }
 
-size_t find_random_chunk_owner (int cid)
+/**
+ * @brief  Choose a random worker that is not used yet, and not in a rack.
+ * @param  used   The workers already chosen.
+ * @param  count  The amount of workers already chosen.
+ * @param  rack   The rack to avoid, or NONE.
+ * @return The worker ID.
+ */
+static size_t random_worker_not_in (size_t* used, int count, size_t rack)
 {
-    int     replica;
-    size_t  owner = NONE;
+    int     i;
     size_t  wid;
 
-    replica = rand () % config.chunk_replicas;
+    for (;;)
+    {
+	wid = rand () % config.number_of_workers;
 
-    for (wid = 0; wid < config.number_of_workers; wid++)
+	if (rack != NONE && config.worker_rack[wid] == rack)
+	    continue;
+
+	for (i = 0; i < count && used[i] != wid; i++);
+
+	if (i == count)
+	    return wid;
+    }
+}
+
+int chunk_is_local (job_t job, size_t cid, size_t wid)
+{
+    size_t                i;
+    struct chunk_owner_s* chunk_owner = &job->chunk_owner;
+
+    for (i = chunk_owner->chunk_start[cid]; i < chunk_owner->chunk_start[cid + 1]; i++)
     {
-	if (chunk_owner[cid][wid])
-	{
-	    owner = wid;
+	if (chunk_owner->owner[i] == wid)
+	    return 1;
+    }
 
-	    if (replica == 0)
-		break;
-	    else
-		replica--;
-	}
+    return 0;
+}
+
+int chunk_is_rack_local (job_t job, size_t cid, size_t wid)
+{
+    size_t                i;
+    struct chunk_owner_s* chunk_owner = &job->chunk_owner;
+
+    for (i = chunk_owner->chunk_start[cid]; i < chunk_owner->chunk_start[cid + 1]; i++)
+    {
+	if (config.worker_rack[chunk_owner->owner[i]] == config.worker_rack[wid])
+	    return 1;
     }
 
-    xbt_assert (owner != NONE, "Aborted: chunk %d is missing.", cid);
+    return 0;
+}
 
-    return owner;
+int chunk_is_available (job_t job, size_t cid)
+{
+    return job->chunk_owner.chunk_start[cid + 1] > job->chunk_owner.chunk_start[cid];
+}
+
+size_t find_random_chunk_owner (job_t job, size_t cid)
+{
+    size_t                replicas;
+    struct chunk_owner_s* chunk_owner = &job->chunk_owner;
+
+    replicas = chunk_owner->chunk_start[cid + 1] - chunk_owner->chunk_start[cid];
+
+    /* All the replicas are on lost workers. */
+    if (replicas == 0)
+	return NONE;
+
+    return chunk_owner->owner[chunk_owner->chunk_start[cid] + rand () % replicas];
+}
+
+size_t find_closest_chunk_owner (job_t job, size_t cid, size_t wid)
+{
+    size_t                choice;
+    size_t                i;
+    size_t                in_rack = 0;
+    struct chunk_owner_s* chunk_owner = &job->chunk_owner;
+
+    for (i = chunk_owner->chunk_start[cid]; i < chunk_owner->chunk_start[cid + 1]; i++)
+	if (config.worker_rack[chunk_owner->owner[i]] == config.worker_rack[wid])
+	    in_rack++;
+
+    if (in_rack == 0)
+	return find_random_chunk_owner (job, cid);
+
+    choice = rand () % in_rack;
+    for (i = chunk_owner->chunk_start[cid]; ; i++)
+    {
+	if (config.worker_rack[chunk_owner->owner[i]] == config.worker_rack[wid] && choice-- == 0)
+	    return chunk_owner->owner[i];
+    }
 }
 
 int data_node (int argc, char* argv[])
 {
-    char         mailbox[MAILBOX_ALIAS_SIZE];
     msg_error_t  status;
     msg_task_t   msg = NULL;
+    w_info_t     wi;
 
-    sprintf (mailbox, DATANODE_MAILBOX, get_worker_id (MSG_host_self ()));
+    wi = (w_info_t) MSG_host_get_data (MSG_host_self ());
 
-    while (!job.finished)
+    while (!workload.finished)
     {
 	msg = NULL;
-	status = receive (&msg, mailbox);
+	status = receive (&msg, wi->datanode);
 	if (status == MSG_OK)
 	{
-	    if (message_is (msg, SMS_FINISH))
+	    if (message_kind (msg) == SMS_FINISH)
 	    {
-		MSG_task_destroy (msg);
+		destroy_message (msg);
 		break;
 	    }
 	    else
@@ -132,29 +517,31 @@ int data_node (int argc, char* argv[])
 
 static void send_data (msg_task_t msg)
 {
-    char         mailbox[MAILBOX_ALIAS_SIZE];
     double       data_size;
+    message_t    m;
     size_t       my_id;
-    task_info_t  ti;
+    shuffle_t    sh;
 
     my_id = get_worker_id (MSG_host_self ());
+    m = (message_t) MSG_task_get_data (msg);
 
-    sprintf (mailbox, TASK_MAILBOX,
-	    get_worker_id (MSG_task_get_source (msg)),
-	    MSG_process_get_PID (MSG_task_get_sender (msg)));
-
-    if (message_is (msg, SMS_GET_CHUNK))
+    if (get_worker_info (my_id)->failed)
+    {
+	/* The worker is down, so the connection is refused at once. */
+	dsend (new_message (SMS_DATA_LOST, NULL), 0.0, m->reply);
+    }
+    else if (m->kind == SMS_GET_CHUNK)
     {
-	MSG_task_dsend (MSG_task_create ("DATA-C", 0.0, config.chunk_size, NULL), mailbox, NULL);
+	disk_read_and_send (SMS_DATA_CHUNK, config.chunk_size, m->reply);
     }
-    else if (message_is (msg, SMS_GET_INTER_PAIRS))
+    else if (m->kind == SMS_GET_INTER_PAIRS)
     {
-	ti = (task_info_t) MSG_task_get_data (msg);
-	data_size = job.map_output[my_id][ti->id] - ti->map_output_copied[my_id];
-	MSG_task_dsend (MSG_task_create ("DATA-IP", 0.0, data_size, NULL), mailbox, NULL);
+	sh = (shuffle_t) m->data;
+	data_size = sh->job->map_output[my_id][sh->rid] - sh->copied[my_id];
+	disk_read_and_send (SMS_DATA_PAIRS, data_size, m->reply);
     }
 
-    MSG_task_destroy (msg);
+    destroy_message (msg);
 }
 
 // vim: set ts=8 sw=4:
@@ -0,0 +1,262 @@
+/* Copyright (c) 2012. MRSG Team. All rights reserved. */
+
+/* This file is part of MRSG.
+
+MRSG is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+MRSG is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "worker.h"
+#include "disk.h"
+
+XBT_LOG_EXTERNAL_DEFAULT_CATEGORY (msg_test);
+
+/** @brief  A pending disk request. */
+typedef struct disk_request_s {
+    double       read;	/* Bytes left to read. */
+    double       write;	/* Bytes left to write. */
+    enum sms_kind_e reply_kind;
+    double       reply_size;
+    char         mailbox[WORKER_MAILBOX_SIZE];
+    struct disk_request_s* next;
+}* disk_request_t;
+
+static void disk_request (disk_request_t req);
+static double disk_bandwidth (msg_host_t host, const char* property, double bandwidth);
+static int merge_passes (uint64_t segments);
+
+int disk (int argc, char* argv[])
+{
+    double          block;
+    double          read_bw;
+    double          write_bw;
+    disk_request_t  head = NULL;
+    disk_request_t  tail = NULL;
+    disk_request_t  req;
+    int             finished = 0;
+    msg_error_t     status;
+    msg_host_t      me;
+    msg_task_t      msg = NULL;
+    w_info_t        wi;
+
+    me = MSG_host_self ();
+    wi = (w_info_t) MSG_host_get_data (me);
+    read_bw = disk_bandwidth (me, "disk_read_bandwidth", config.disk_read_bandwidth);
+    write_bw = disk_bandwidth (me, "disk_write_bandwidth", config.disk_write_bandwidth);
+
+    while (!finished)
+    {
+	/* Block when idle, otherwise just take the requests that arrived. */
+	while (!finished && (head == NULL || MSG_task_listen (wi->disk)))
+	{
+	    msg = NULL;
+	    status = receive (&msg, wi->disk);
+	    if (status != MSG_OK)
+		continue;
+
+	    if (message_kind (msg) == SMS_FINISH)
+	    {
+		finished = 1;
+	    }
+	    else
+	    {
+		req = (disk_request_t) ((message_t) MSG_task_get_data (msg))->data;
+		req->next = NULL;
+		if (tail == NULL)
+		    head = req;
+		else
+		    tail->next = req;
+		tail = req;
+	    }
+	    destroy_message (msg);
+	}
+
+	if (finished)
+	    break;
+
+	/* Serve one block of the first request. */
+	req = head;
+	head = req->next;
+	if (head == NULL)
+	    tail = NULL;
+
+	if (req->read > 0)
+	{
+	    block = (req->read < DISK_BLOCK_SIZE ? req->read : DISK_BLOCK_SIZE);
+	    MSG_process_sleep (block / read_bw);
+	    req->read -= block;
+	}
+	else
+	{
+	    block = (req->write < DISK_BLOCK_SIZE ? req->write : DISK_BLOCK_SIZE);
+	    MSG_process_sleep (block / write_bw);
+	    req->write -= block;
+	}
+
+	if (req->read > 0 || req->write > 0)
+	{
+	    req->next = NULL;
+	    if (tail == NULL)
+		head = req;
+	    else
+		tail->next = req;
+	    tail = req;
+	}
+	else
+	{
+	    dsend (new_message (req->reply_kind, NULL), req->reply_size, req->mailbox);
+	    xbt_free (req);
+	}
+    }
+
+    while (head != NULL)
+    {
+	req = head;
+	head = req->next;
+	xbt_free (req);
+    }
+
+    return 0;
+}
+
+void disk_io (double read_bytes, double write_bytes, const char* mailbox)
+{
+    disk_request_t  req;
+    msg_error_t     status;
+    msg_task_t      msg = NULL;
+
+    if (config.disk_read_bandwidth <= 0.0 || read_bytes + write_bytes <= 0.0)
+	return;
+
+    req = xbt_new (struct disk_request_s, 1);
+    req->read = read_bytes;
+    req->write = write_bytes;
+    req->reply_kind = SMS_DISK;
+    req->reply_size = 0.0;
+    strcpy (req->mailbox, mailbox);
+    disk_request (req);
+
+    status = receive (&msg, mailbox);
+    if (status == MSG_OK)
+	destroy_message (msg);
+}
+
+void disk_read_and_send (enum sms_kind_e kind, double bytes, const char* mailbox)
+{
+    disk_request_t  req;
+
+    if (config.disk_read_bandwidth <= 0.0 || bytes <= 0.0)
+    {
+	dsend (new_message (kind, NULL), bytes, mailbox);
+	return;
+    }
+
+    req = xbt_new (struct disk_request_s, 1);
+    req->read = bytes;
+    req->write = 0.0;
+    req->reply_kind = kind;
+    req->reply_size = bytes;
+    strcpy (req->mailbox, mailbox);
+    disk_request (req);
+}
+
+void map_spill (job_t job, size_t mid, const char* mailbox)
+{
+    int       passes;
+    uint64_t  output;
+    uint64_t  spills;
+
+    output = map_output_size (job, mid);
+    if (output == 0)
+	return;
+
+    /* The sort buffer is spilled whenever it fills up, and the spills are
+     * merged config.io_sort_factor at a time into a single file. */
+    spills = (output + config.io_sort_buffer - 1) / config.io_sort_buffer;
+    passes = merge_passes (spills);
+
+    disk_io ((double) output * passes, (double) output * (1 + passes), mailbox);
+}
+
+void reduce_merge (job_t job, size_t rid, const char* mailbox)
+{
+    int       passes;
+    uint64_t  input;
+
+    input = reduce_input_size (job, rid);
+    if (input == 0)
+	return;
+
+    /* The copied segments (one per map) are written to disk, merged until
+     * config.io_sort_factor are left, and the last merge feeds the reduce. */
+    passes = merge_passes (job->amount_of_tasks[MAP]) - 1;
+    if (passes < 0)
+	passes = 0;
+
+    disk_io ((double) input * (1 + passes), (double) input * (1 + passes), mailbox);
+}
+
+/**
+ * @brief  Send a request to the disk of this worker.
+ * @param  req  The request.
+ */
+static void disk_request (disk_request_t req)
+{
+    w_info_t  wi;
+
+    wi = (w_info_t) MSG_host_get_data (MSG_host_self ());
+    dsend (new_message (SMS_DISK, req), 0.0, wi->disk);
+}
+
+/**
+ * @brief  Get the disk bandwidth of a host.
+ * @param  host       The host.
+ * @param  property   The host property that overrides the default (MB/s).
+ * @param  bandwidth  The default bandwidth (bytes/s).
+ * @return The bandwidth in bytes/s.
+ */
+static double disk_bandwidth (msg_host_t host, const char* property, double bandwidth)
+{
+    const char*  value;
+
+    value = MSG_host_get_property_value (host, property);
+    if (value != NULL)
+	bandwidth = atof (value) * 1024 * 1024;
+
+    xbt_assert (bandwidth > 0.0, "Invalid %s of host %s", property, MSG_host_get_name (host));
+
+    return bandwidth;
+}
+
+/**
+ * @brief  Count the merge passes needed to merge sorted segments into one.
+ * @param  segments  The number of segments.
+ * @return The number of passes.
+ */
+static int merge_passes (uint64_t segments)
+{
+    int  passes = 0;
+
+    while (segments > 1)
+    {
+	segments = (segments + config.io_sort_factor - 1) / config.io_sort_factor;
+	passes++;
+    }
+
+    return passes;
+}
+
+// vim: set ts=8 sw=4:
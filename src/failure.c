@@ -0,0 +1,257 @@
+/* Copyright (c) 2012. MRSG Team. All rights reserved. */
+
+/* This file is part of MRSG.
+
+MRSG is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+MRSG is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "common.h"
+#include "worker.h"
+#include "speculation.h"
+#include "failure.h"
+
+XBT_LOG_EXTERNAL_DEFAULT_CATEGORY (msg_test);
+
+/** @brief  A change of state of a worker, from the failure trace. */
+struct failure_event_s {
+    double  time;
+    size_t  wid;
+    int     up;
+};
+
+/** @brief  A failure injection process. */
+struct injector_s {
+    msg_process_t  process;	/* NULL once it ended. */
+    size_t         wid;
+};
+
+static int replay_failures (int argc, char* argv[]);
+static int random_failures (int argc, char* argv[]);
+static void read_failure_trace (const char* file_name);
+static int compare_events (const void* a, const void* b);
+static double exponential (double mean);
+
+static struct failure_event_s*  events;
+static size_t                   event_count;
+static struct injector_s*       injectors;
+static size_t                   injector_count;
+
+
+void start_failures (msg_host_t host)
+{
+    size_t  wid;
+
+    injectors = xbt_new0 (struct injector_s, config.number_of_workers + 1);
+    injector_count = 0;
+
+    if (config.failure_trace != NULL)
+    {
+	read_failure_trace (config.failure_trace);
+	injectors[injector_count].process = MSG_process_create ("failures", replay_failures, &injectors[injector_count], host);
+	injector_count++;
+    }
+
+    if (config.failure_mtbf > 0.0)
+    {
+	for (wid = 0; wid < config.number_of_workers; wid++)
+	{
+	    injectors[injector_count].wid = wid;
+	    injectors[injector_count].process = MSG_process_create ("failures", random_failures, &injectors[injector_count], host);
+	    injector_count++;
+	}
+    }
+}
+
+void stop_failures (void)
+{
+    size_t  i;
+
+    /* The injectors would otherwise keep the simulation going. */
+    for (i = 0; i < injector_count; i++)
+    {
+	if (injectors[i].process != NULL)
+	    MSG_process_kill (injectors[i].process);
+    }
+
+    xbt_free_ref (&injectors);
+    xbt_free_ref (&events);
+    injector_count = 0;
+    event_count = 0;
+}
+
+void fail_worker (size_t wid)
+{
+    size_t        count;
+    size_t        i;
+    task_info_t*  tasks;
+    w_info_t      wi;
+
+    wi = get_worker_info (wid);
+    if (wi->failed)
+	return;
+
+    XBT_INFO ("worker %s fails", MSG_host_get_name (config.workers[wid]));
+    wi->failed = 1;
+
+    /* Stop the copies that run there. */
+    count = running_tasks (wid, &tasks);
+    for (i = 0; i < count; i++)
+    {
+	if (!tasks[i]->lost)
+	{
+	    tasks[i]->lost = 1;
+	    MSG_task_cancel (tasks[i]->task);
+	}
+    }
+}
+
+void recover_worker (size_t wid)
+{
+    w_info_t  wi;
+
+    wi = get_worker_info (wid);
+    if (!wi->failed)
+	return;
+
+    XBT_INFO ("worker %s recovers", MSG_host_get_name (config.workers[wid]));
+    wi->failed = 0;
+    wi->incarnation++;
+    wi->restarted = 1;
+    memset (&wi->freed, 0, sizeof (struct resources_s));
+}
+
+/**
+ * @brief  Process that replays the failure trace.
+ */
+static int replay_failures (int argc, char* argv[])
+{
+    size_t              i;
+    struct injector_s*  me;
+
+    me = (struct injector_s*) MSG_process_get_data (MSG_process_self ());
+
+    for (i = 0; i < event_count && !workload.finished; i++)
+    {
+	if (events[i].time > sim_clock ())
+	    MSG_process_sleep (events[i].time - sim_clock ());
+
+	if (events[i].up)
+	    recover_worker (events[i].wid);
+	else
+	    fail_worker (events[i].wid);
+    }
+
+    me->process = NULL;
+    return 0;
+}
+
+/**
+ * @brief  Process that makes a worker fail at random times.
+ */
+static int random_failures (int argc, char* argv[])
+{
+    struct injector_s*  me;
+
+    me = (struct injector_s*) MSG_process_get_data (MSG_process_self ());
+
+    while (!workload.finished)
+    {
+	MSG_process_sleep (exponential (config.failure_mtbf));
+	fail_worker (me->wid);
+	MSG_process_sleep (exponential (config.failure_mttr));
+	recover_worker (me->wid);
+    }
+
+    me->process = NULL;
+    return 0;
+}
+
+/**
+ * @brief  Read the failure trace, and sort its events by time.
+ * @param  file_name  The trace file.
+ */
+static void read_failure_trace (const char* file_name)
+{
+    char        name[257];
+    double      downtime;
+    double      time;
+    FILE*       file;
+    msg_host_t  host;
+    size_t      capacity = 0;
+
+    file = fopen (file_name, "r");
+    xbt_assert (file != NULL, "Error reading failure trace %s", file_name);
+
+    events = NULL;
+    event_count = 0;
+
+    while (fscanf (file, "%lg %256s %lg", &time, name, &downtime) == 3)
+    {
+	host = MSG_get_host_by_name (name);
+	xbt_assert (host != NULL && host != config.master && MSG_host_get_data (host) != NULL,
+		"Host %s of the failure trace is not a worker", name);
+	xbt_assert (time >= 0.0, "Failure times can't be negative (%s)", file_name);
+
+	if (event_count + 2 > capacity)
+	{
+	    capacity = 2 * capacity + 16;
+	    events = xbt_realloc (events, capacity * sizeof (struct failure_event_s));
+	}
+
+	events[event_count].time = time;
+	events[event_count].wid = get_worker_id (host);
+	events[event_count].up = 0;
+	event_count++;
+
+	if (downtime >= 0.0)
+	{
+	    events[event_count].time = time + downtime;
+	    events[event_count].wid = get_worker_id (host);
+	    events[event_count].up = 1;
+	    event_count++;
+	}
+    }
+
+    fclose (file);
+
+    qsort (events, event_count, sizeof (struct failure_event_s), compare_events);
+}
+
+/**
+ * @brief  Order the events by time, with the recoveries first.
+ */
+static int compare_events (const void* a, const void* b)
+{
+    const struct failure_event_s*  ea = (const struct failure_event_s*) a;
+    const struct failure_event_s*  eb = (const struct failure_event_s*) b;
+
+    if (ea->time != eb->time)
+	return (ea->time < eb->time ? -1 : 1);
+
+    return eb->up - ea->up;
+}
+
+/**
+ * @brief  Draw an exponential random time.
+ * @param  mean  The mean.
+ * @return The time.
+ */
+static double exponential (double mean)
+{
+    return -mean * log (1.0 - rand () / (RAND_MAX + 1.0));
+}
+
+// vim: set ts=8 sw=4:
@@ -0,0 +1,333 @@
+/* Copyright (c) 2012. MRSG Team. All rights reserved. */
+
+/* This file is part of MRSG.
+
+MRSG is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+MRSG is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "history.h"
+
+XBT_LOG_EXTERNAL_DEFAULT_CATEGORY (msg_test);
+
+#define HISTORY_FIELDS 6
+#define HISTORY_BUFFER_SIZE (1 << 20)
+
+static void new_history (job_t job);
+static void end_history (job_t job, const char* file_name);
+static void read_task (job_t job, enum phase_e phase, char** field, int fields, const char* file_name, int line_number);
+static void read_splits (job_t job, size_t mid, char* hosts);
+static int split_fields (char* line, char** field);
+static double number_field (const char* field, const char* file_name, int line_number);
+
+static size_t  split_capacity;	/* Of the job being read. */
+
+void read_job_history (const char* file_name)
+{
+    char*    field[HISTORY_FIELDS];
+    char*    line = NULL;
+    double   first_submit = 0.0;
+    double   submit_time;
+    FILE*    file;
+    int      fields;
+    int      line_number = 0;
+    job_t    job = NULL;
+    size_t   capacity = 16;
+    size_t   jid;
+    size_t   line_size = 0;
+    double   maps;
+    double   reduces;
+
+    file = fopen (file_name, "r");
+
+    xbt_assert (file != NULL, "Error reading job history: %s", file_name);
+
+    setvbuf (file, NULL, _IOFBF, HISTORY_BUFFER_SIZE);
+
+    workload.job_count = 0;
+    workload.jobs = xbt_new (job_t, capacity);
+
+    /* Lines may be of any length (long host lists). */
+    while ( getline (&line, &line_size, file) != -1 )
+    {
+	line_number++;
+
+	fields = split_fields (line, field);
+
+	if (fields == 0 || field[0][0] == '#')
+	    continue;
+
+	if ( strcmp (field[0], "job") == 0 )
+	{
+	    xbt_assert (fields >= 4, "Invalid job in %s, line %d", file_name, line_number);
+
+	    if (job != NULL)
+		end_history (job, file_name);
+
+	    submit_time = number_field (field[1], file_name, line_number);
+	    maps = number_field (field[2], file_name, line_number);
+	    reduces = number_field (field[3], file_name, line_number);
+	    xbt_assert (submit_time >= 0.0, "Submit time can't be negative (%s, line %d)", file_name, line_number);
+	    xbt_assert (maps >= 1.0, "The amount of map tasks must be greater than zero (%s, line %d)", file_name, line_number);
+	    xbt_assert (reduces >= 0.0, "The number of reduce tasks can't be negative (%s, line %d)", file_name, line_number);
+
+	    if (workload.job_count == capacity)
+	    {
+		capacity *= 2;
+		workload.jobs = xbt_realloc (workload.jobs, capacity * sizeof (job_t));
+	    }
+
+	    job = new_job (submit_time, (int) maps, (int) reduces);
+	    if (fields > 4 && field[4][0] != '\0')
+		job->pool = find_pool (field[4]);
+	    new_history (job);
+
+	    if (workload.job_count == 0 || submit_time < first_submit)
+		first_submit = submit_time;
+
+	    workload.jobs[workload.job_count++] = job;
+	}
+	else if ( strcmp (field[0], "map") == 0 )
+	{
+	    xbt_assert (job != NULL, "Map before the first job in %s, line %d", file_name, line_number);
+	    read_task (job, MAP, field, fields, file_name, line_number);
+	}
+	else if ( strcmp (field[0], "reduce") == 0 )
+	{
+	    xbt_assert (job != NULL, "Reduce before the first job in %s, line %d", file_name, line_number);
+	    read_task (job, REDUCE, field, fields, file_name, line_number);
+	}
+    }
+
+    if (job != NULL)
+	end_history (job, file_name);
+
+    free (line);
+    fclose (file);
+
+    xbt_assert (workload.job_count > 0, "No jobs in job history: %s", file_name);
+
+    /* Histories have absolute times. */
+    for (jid = 0; jid < workload.job_count; jid++)
+	workload.jobs[jid]->submit_time -= first_submit;
+}
+
+void free_history (job_t job)
+{
+    struct history_s* history = job->history;
+
+    if (history == NULL)
+	return;
+
+    xbt_free_ref (&history->seconds[MAP]);
+    xbt_free_ref (&history->seconds[REDUCE]);
+    xbt_free_ref (&history->map_output);
+    xbt_free_ref (&history->shuffle);
+    xbt_free_ref (&history->split_map);
+    xbt_free_ref (&history->split_host);
+    xbt_free_ref (&job->history);
+}
+
+double history_task_cost (job_t job, enum phase_e phase, size_t tid)
+{
+    return job->history->seconds[phase][tid] * config.grid_average_speed;
+}
+
+uint64_t history_map_output (job_t job, size_t mid, size_t rid)
+{
+    struct history_s* history = job->history;
+
+    if (history->map_output_total == 0)
+	return history->shuffle[rid] / job->amount_of_tasks[MAP];
+
+    return (uint64_t) ((double) history->shuffle[rid] * history->map_output[mid] / history->map_output_total + 0.5);
+}
+
+/**
+ * @brief  Allocate the history of a new job.
+ * @param  job  The job.
+ */
+static void new_history (job_t job)
+{
+    enum phase_e       phase;
+    size_t             tid;
+    struct history_s*  history;
+
+    history = xbt_new0 (struct history_s, 1);
+
+    for (phase = MAP; phase <= REDUCE; phase++)
+    {
+	/* Negative until the record of the task is read. */
+	history->seconds[phase] = xbt_new (double, job->amount_of_tasks[phase]);
+	for (tid = 0; tid < job->amount_of_tasks[phase]; tid++)
+	    history->seconds[phase][tid] = -1.0;
+    }
+    history->map_output = xbt_new0 (uint64_t, job->amount_of_tasks[MAP]);
+    history->shuffle = xbt_new0 (uint64_t, job->amount_of_tasks[REDUCE]);
+
+    job->history = history;
+    split_capacity = 0;
+}
+
+/**
+ * @brief  Check that every task of a job was read, and trim its splits.
+ * @param  job        The job.
+ * @param  file_name  The history file.
+ */
+static void end_history (job_t job, const char* file_name)
+{
+    enum phase_e       phase;
+    size_t             tid;
+    struct history_s*  history = job->history;
+
+    for (phase = MAP; phase <= REDUCE; phase++)
+	for (tid = 0; tid < job->amount_of_tasks[phase]; tid++)
+	    xbt_assert (history->seconds[phase][tid] >= 0.0, "Job %zu of %s has no record of %s %zu",
+		    job->id, file_name, (phase == MAP ? "map" : "reduce"), tid);
+
+    for (tid = 0; tid < job->amount_of_tasks[MAP]; tid++)
+	history->map_output_total += history->map_output[tid];
+
+    if (history->split_count > 0)
+    {
+	history->split_map = xbt_realloc (history->split_map, history->split_count * sizeof (size_t));
+	history->split_host = xbt_realloc (history->split_host, history->split_count * sizeof (msg_host_t));
+    }
+}
+
+/**
+ * @brief  Read the record of a task.
+ * @param  job          The job of the task.
+ * @param  phase        MAP or REDUCE.
+ * @param  field        The fields of the record.
+ * @param  fields       The amount of fields.
+ * @param  file_name    The history file.
+ * @param  line_number  The line of the record.
+ */
+static void read_task (job_t job, enum phase_e phase, char** field, int fields, const char* file_name, int line_number)
+{
+    double             bytes;
+    double             id;
+    double             seconds;
+    size_t             tid;
+    struct history_s*  history = job->history;
+
+    xbt_assert (fields >= 4, "Invalid task in %s, line %d", file_name, line_number);
+
+    id = number_field (field[1], file_name, line_number);
+    seconds = number_field (field[2], file_name, line_number);
+    bytes = number_field (field[3], file_name, line_number);
+
+    xbt_assert (id >= 0.0 && id < job->amount_of_tasks[phase], "Invalid task ID in %s, line %d", file_name, line_number);
+    tid = (size_t) id;
+    xbt_assert (seconds >= 0.0 && bytes >= 0.0, "Task costs can't be negative (%s, line %d)", file_name, line_number);
+
+    history->seconds[phase][tid] = seconds;
+
+    if (phase == MAP)
+    {
+	history->map_output[tid] = (uint64_t) bytes;
+	if (fields > 4)
+	    read_splits (job, tid, field[4]);
+    }
+    else
+    {
+	history->shuffle[tid] = (uint64_t) bytes;
+    }
+}
+
+/**
+ * @brief  Read the hosts of the input split of a map.
+ * @param  job    The job.
+ * @param  mid    The map task ID.
+ * @param  hosts  The host names, separated by ';'.
+ */
+static void read_splits (job_t job, size_t mid, char* hosts)
+{
+    char*              name;
+    char*              next;
+    struct history_s*  history = job->history;
+
+    for (name = strtok_r (hosts, ";", &next); name != NULL; name = strtok_r (NULL, ";", &next))
+    {
+	if (history->split_count == split_capacity)
+	{
+	    split_capacity = 2 * split_capacity + 1;
+	    history->split_map = xbt_realloc (history->split_map, split_capacity * sizeof (size_t));
+	    history->split_host = xbt_realloc (history->split_host, split_capacity * sizeof (msg_host_t));
+	}
+	history->split_map[history->split_count] = mid;
+	history->split_host[history->split_count] = MSG_get_host_by_name (name);
+	history->split_count++;
+    }
+}
+
+/**
+ * @brief  Split a CSV line into its fields, in place.
+ * @param  line   The line.
+ * @param  field  Where to store the fields, at most HISTORY_FIELDS.
+ * @return The amount of fields, zero for a blank line.
+ */
+static int split_fields (char* line, char** field)
+{
+    char*  end;
+    int    fields = 0;
+
+    /* Drop the line end and any trailing blanks. */
+    end = line + strlen (line);
+    while (end > line && strchr (" \t\r\n", end[-1]) != NULL)
+	end--;
+    *end = '\0';
+
+    line += strspn (line, " \t");
+    if (*line == '\0')
+	return 0;
+
+    while (fields < HISTORY_FIELDS)
+    {
+	field[fields++] = line;
+	end = strchr (line, ',');
+	if (end == NULL)
+	    break;
+	*end = '\0';
+	line = end + 1;
+    }
+
+    return fields;
+}
+
+/**
+ * @brief  Parse a numeric field.
+ * @param  field        The field.
+ * @param  file_name    The history file.
+ * @param  line_number  The line of the field.
+ * @return The number.
+ */
+static double number_field (const char* field, const char* file_name, int line_number)
+{
+    char*   end;
+    double  value;
+
+    errno = 0;
+    value = strtod (field, &end);
+    xbt_assert (end != field && errno == 0 && end[strspn (end, " \t")] == '\0',
+	    "Invalid number \"%s\" in %s, line %d", field, file_name, line_number);
+
+    return value;
+}
+
+// vim: set ts=8 sw=4:
@@ -21,242 +21,595 @@ along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
 #include "common.h"
 #include "worker.h"
 #include "dfs.h"
+#include "scheduling.h"
+#include "speculation.h"
+#include "trace.h"
+#include "objpool.h"
+#include "failure.h"
 
 XBT_LOG_EXTERNAL_DEFAULT_CATEGORY (msg_test);
 
-static FILE*       tasks_log;
 
+/* Workers with free slots of each phase, in arrival order (push mode). */
+static size_t*     ready[2];
+static size_t      ready_head[2];
+static size_t      ready_count[2];
+static char*       is_ready[2];
+
+static int submitter (int argc, char* argv[]);
+static void submit_job (job_t job);
+static void finish_job (job_t job);
 static void print_config (void);
 static void print_stats (void);
-static int is_straggler (msg_host_t worker);
-static int task_time_elapsed (msg_task_t task);
-static void set_speculative_tasks (msg_host_t worker);
-static void send_scheduler_task (enum phase_e phase, size_t wid);
-static void update_stats (enum task_type_e task_type);
-static void send_task (enum phase_e phase, size_t tid, size_t data_src, size_t wid);
+static void write_results (void);
+static int send_scheduler_task (enum phase_e phase, size_t wid);
+static void init_ready_workers (void);
+static void free_ready_workers (void);
+static void push_ready_worker (size_t wid);
+static void assign_ready_workers (void);
+static void pop_ready_worker (int phase);
+static void update_stats (job_t job, enum task_type_e task_type);
+static void count_task (struct stats_s* st, enum task_type_e task_type);
+static void send_task (job_t job, enum phase_e phase, size_t tid, size_t data_src, size_t wid);
+static void count_running (job_t job, enum phase_e phase, int delta);
+static void preempt_tasks (void);
+static int kill_newest_task (job_t job, enum phase_e phase);
 char* task_type_string (enum task_type_e task_type);
 static void finish_all_task_copies (task_info_t ti);
+static int worker_usable (size_t wid);
+static void expire_workers (void);
+static void worker_lost (size_t wid);
+static void worker_recovered (size_t wid);
+static int find_task_copy (task_info_t ti);
+static void lose_task_copy (task_info_t ti, int i);
 
 
 /** @brief  Main master function. */
 int master (int argc, char* argv[])
 {
-    heartbeat_t  heartbeat;
+    enum phase_e phase;
+    int          r;
+    int          sent;
+    job_t        job;
+    message_t    m;
     msg_error_t  status;
-    msg_host_t   worker;
     msg_task_t   msg = NULL;
+    resources_t  heartbeat;
     size_t       wid;
     task_info_t  ti;
 
     print_config ();
     XBT_INFO ("JOB BEGIN"); XBT_INFO (" ");
 
-    tasks_log = fopen ("tasks.csv", "w");
-    fprintf (tasks_log, "task_id,phase,worker_id,time,action,shuffle_end\n");
+    if (config.trace_level != MRSG_TRACE_OFF)
+	trace_open (config.task_trace);
+
+    if (config.heartbeat_mode == HB_PUSH)
+	init_ready_workers ();
+
+    start_failures (MSG_host_self ());
 
-    while (job.tasks_pending[MAP] + job.tasks_pending[REDUCE] > 0)
+    /* Jobs are submitted by a separate process, at their submit times. */
+    MSG_process_create ("submitter", submitter, NULL, MSG_host_self ());
+
+    while (workload.jobs_done < workload.job_count)
     {
 	msg = NULL;
 	status = receive (&msg, MASTER_MAILBOX);
+	perf.master_iterations++;
+
+	if (sim_clock () >= workload.next_expiry)
+	    expire_workers ();
+
 	if (status == MSG_OK)
 	{
-	    worker = MSG_task_get_source (msg);
-	    wid = get_worker_id (worker);
-
-	    if (message_is (msg, SMS_HEARTBEAT))
+	    if (message_kind (msg) == SMS_SUBMIT)
+	    {
+		submit_job ((job_t) ((message_t) MSG_task_get_data (msg))->data);
+	    }
+	    else if (message_kind (msg) == SMS_HEARTBEAT)
 	    {
-		heartbeat = &job.heartbeats[wid];
+		m = (message_t) MSG_task_get_data (msg);
+		wid = m->wid;
+		heartbeat = &workload.heartbeats[wid];
+		workload.last_seen[wid] = sim_clock ();
 
-		if (is_straggler (worker))
+		/* A restarted worker lost its tasks and its map output. */
+		if (m->restarted)
 		{
-		    set_speculative_tasks (worker);
+		    if (!workload.lost[wid])
+			worker_lost (wid);
+		    worker_recovered (wid);
 		}
-		else
+
+		/* The heartbeat reports the resources freed since the last
+		 * one. In push mode the master counts them from the completions. */
+		if (config.heartbeat_mode != HB_PUSH && worker_usable (wid))
 		{
-		    if (heartbeat->slots_av[MAP] > 0)
-			send_scheduler_task(MAP, wid);
+		    for (r = 0; r < RESOURCES; r++)
+			heartbeat->amount[r] += m->heartbeat.amount[r];
+		}
+
+		if (user.scheduler_f == fair_scheduler_f && config.preemption_timeout > 0.0)
+		    preempt_tasks ();
+
+		update_task_progress (wid);
 
-		    if (heartbeat->slots_av[REDUCE] > 0)
-			send_scheduler_task(REDUCE, wid);
+		if (config.heartbeat_mode == HB_PUSH)
+		{
+		    push_ready_worker (wid);
+		}
+		else
+		{
+		    /* Slots get a task of each phase per heartbeat, as in
+		     * Hadoop 1. Containers are packed while they fit. */
+		    do
+		    {
+			sent = 0;
+			for (phase = MAP; phase <= REDUCE; phase++)
+			    if (task_fits (heartbeat, phase))
+				sent += send_scheduler_task (phase, wid);
+		    } while (sent > 0 && config.resource_model == RM_CONTAINERS);
 		}
 	    }
-	    else if (message_is (msg, SMS_TASK_DONE))
+	    else if (message_kind (msg) == SMS_TASK_DONE
+		    && ((task_info_t) MSG_task_get_data (msg))->lost)
+	    {
+		/* The worker failed after the copy ended. Its result is lost,
+		 * and the copy is dropped with the worker (see worker_lost). */
+	    }
+	    else if (message_kind (msg) == SMS_TASK_DONE)
 	    {
 		ti = (task_info_t) MSG_task_get_data (msg);
+		job = ti->job;
+		wid = ti->wid;
+		phase = ti->phase;
+		workload.last_seen[wid] = sim_clock ();
+
+		/* Preempted and cancelled copies were discounted when killed. */
+		if (!ti->killed)
+		    count_running (job, ti->phase, -1);
+
+		task_finished (ti, !ti->killed && job->task_status[ti->phase][ti->id] != T_STATUS_DONE);
 
-		if (job.task_status[ti->phase][ti->id] != T_STATUS_DONE)
+		if (!ti->killed && job->task_status[ti->phase][ti->id] != T_STATUS_DONE)
 		{
-		    job.task_status[ti->phase][ti->id] = T_STATUS_DONE;
+		    job->task_status[ti->phase][ti->id] = T_STATUS_DONE;
+		    if (ti->phase == MAP)
+		    {
+			job->map_worker[ti->id] = ti->wid;
+			update_locality_index (job, ti->id);
+		    }
 		    finish_all_task_copies (ti);
-		    job.tasks_pending[ti->phase]--;
-		    if (job.tasks_pending[ti->phase] <= 0)
+		    job->tasks_pending[ti->phase]--;
+		    if (job->tasks_pending[ti->phase] <= 0)
 		    {
 			XBT_INFO (" ");
-			XBT_INFO ("%s PHASE DONE", (ti->phase==MAP?"MAP":"REDUCE"));
+			XBT_INFO ("JOB %zu %s PHASE DONE", job->id, (ti->phase==MAP?"MAP":"REDUCE"));
 			XBT_INFO (" ");
 		    }
+		    if (job->tasks_pending[MAP] + job->tasks_pending[REDUCE] <= 0)
+			finish_job (job);
+		}
+		release_task_info (ti);
+
+		/* The resources of the task are free again. */
+		if (config.heartbeat_mode == HB_PUSH && worker_usable (wid))
+		{
+		    release_resources (&workload.heartbeats[wid], phase);
+		    push_ready_worker (wid);
 		}
-		xbt_free_ref (&ti);
 	    }
-	    MSG_task_destroy (msg);
+	    destroy_message (msg);
+
+	    if (config.heartbeat_mode == HB_PUSH)
+		assign_ready_workers ();
 	}
     }
 
-    fclose (tasks_log);
+    stop_failures ();
+    trace_close ();
+
+    if (config.heartbeat_mode == HB_PUSH)
+	free_ready_workers ();
 
-    job.finished = 1;
+    workload.finished = 1;
+    perf.simulated_time = sim_clock ();
 
     print_config ();
     print_stats ();
+    if (config.results_file != NULL)
+	write_results ();
     XBT_INFO ("JOB END");
 
     return 0;
 }
 
+/**
+ * @brief  Process that submits the jobs at their submit times.
+ */
+static int submitter (int argc, char* argv[])
+{
+    job_t   job;
+    size_t  jid;
+
+    for (jid = 0; jid < workload.job_count; jid++)
+    {
+	job = workload.jobs[jid];
+
+	if (job->submit_time > sim_clock ())
+	    MSG_process_sleep (job->submit_time - sim_clock ());
+
+	send (new_message (SMS_SUBMIT, job), 0.0, MASTER_MAILBOX);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief  Start scheduling the tasks of a job.
+ * @param  job  The submitted job.
+ */
+static void submit_job (job_t job)
+{
+    init_job (job);
+    workload.active[workload.active_count++] = job;
+
+    XBT_INFO ("JOB %zu SUBMITTED: %d maps, %d reduces", job->id,
+	    job->amount_of_tasks[MAP], job->amount_of_tasks[REDUCE]);
+}
+
+/**
+ * @brief  Mark a job as finished.
+ * @param  job  The job with no pending tasks.
+ */
+static void finish_job (job_t job)
+{
+    size_t  i;
+
+    job->finished = 1;
+    job->end_time = sim_clock ();
+    workload.jobs_done++;
+
+    /* Keep the running jobs in submission order. */
+    for (i = 0; workload.active[i] != job; i++);
+    for (; i + 1 < workload.active_count; i++)
+	workload.active[i] = workload.active[i + 1];
+    workload.active_count--;
+
+    XBT_INFO ("JOB %zu DONE: %.3f s", job->id, job->end_time - job->submit_time);
+    print_obj_pool (&obj_pools.task_infos);
+    print_obj_pool (&obj_pools.shuffles);
+    print_obj_pool (&obj_pools.messages);
+}
+
 /** @brief  Print the job configuration. */
 static void print_config (void)
 {
+    size_t          p;
+    struct pool_s*  pool;
+
     XBT_INFO ("JOB CONFIGURATION:");
-    XBT_INFO ("slots: %d map, %d reduce", config.slots[MAP], config.slots[REDUCE]);
+    if (config.resource_model == RM_CONTAINERS)
+    {
+	XBT_INFO ("containers: map %d MB %d vcores, reduce %d MB %d vcores",
+		config.container[MAP].amount[RES_MEMORY], config.container[MAP].amount[RES_VCORES],
+		config.container[REDUCE].amount[RES_MEMORY], config.container[REDUCE].amount[RES_VCORES]);
+    }
+    else
+    {
+	XBT_INFO ("slots: %d map, %d reduce", config.slots[MAP], config.slots[REDUCE]);
+    }
+    XBT_INFO ("cluster slots: %d map, %d reduce", config.total_slots[MAP], config.total_slots[REDUCE]);
     XBT_INFO ("chunk replicas: %d", config.chunk_replicas);
     XBT_INFO ("chunk size: %.0f MB", config.chunk_size/1024/1024);
-    XBT_INFO ("input chunks: %d", config.chunk_count);
-    XBT_INFO ("input size: %d MB", config.chunk_count * (int)(config.chunk_size/1024/1024));
-    XBT_INFO ("maps: %d", config.amount_of_tasks[MAP]);
-    XBT_INFO ("reduces: %d", config.amount_of_tasks[REDUCE]);
+    if (config.task_trace != NULL && config.trace_level != MRSG_TRACE_OFF)
+	XBT_INFO ("task trace: %s", config.task_trace);
+    if (config.job_history != NULL)
+    {
+	XBT_INFO ("job history: %s", config.job_history);
+	XBT_INFO ("jobs: %zu", workload.job_count);
+    }
+    else if (config.workload_trace != NULL)
+    {
+	XBT_INFO ("workload trace: %s", config.workload_trace);
+	XBT_INFO ("jobs: %zu", workload.job_count);
+    }
+    else
+    {
+	XBT_INFO ("input chunks: %d", config.chunk_count);
+	XBT_INFO ("input size: %d MB", config.chunk_count * (int)(config.chunk_size/1024/1024));
+	XBT_INFO ("maps: %d", config.amount_of_tasks[MAP]);
+	XBT_INFO ("reduces: %d", config.amount_of_tasks[REDUCE]);
+    }
     XBT_INFO ("workers: %d", config.number_of_workers);
     XBT_INFO ("grid power: %g flops", config.grid_cpu_power);
     XBT_INFO ("average power: %g flops/s", config.grid_average_speed);
-    XBT_INFO ("heartbeat interval: %ds", config.heartbeat_interval);
+    if (config.heartbeat_mode == HB_PUSH)
+	XBT_INFO ("keepalive interval: %ds (push mode)", config.keepalive_interval);
+    else
+	XBT_INFO ("heartbeat interval: %ds", config.heartbeat_interval);
+    XBT_INFO ("racks: %zu", config.rack_count);
+    if (config.failure_trace != NULL)
+	XBT_INFO ("failure trace: %s", config.failure_trace);
+    if (config.failure_mtbf > 0.0)
+	XBT_INFO ("failures: MTBF %gs, MTTR %gs", config.failure_mtbf, config.failure_mttr);
+    if (config.locality_delay > 0 || config.rack_locality_delay > 0)
+	XBT_INFO ("delay scheduling: %d node skips, %d rack skips", config.locality_delay, config.rack_locality_delay);
+    if (config.adaptive_slowstart)
+	XBT_INFO ("reduce slow-start: adaptive");
+    else
+	XBT_INFO ("reduce slow-start: %g%% of maps", 100 * config.reduce_slowstart);
+    if (config.disk_read_bandwidth > 0.0)
+	XBT_INFO ("disk: read %g MB/s, write %g MB/s, sort buffer %d MB, sort factor %d",
+		config.disk_read_bandwidth/1024/1024, config.disk_write_bandwidth/1024/1024,
+		(int)(config.io_sort_buffer/1024/1024), config.io_sort_factor);
+    if (config.combiner_ratio < 1.0)
+	XBT_INFO ("combiner: %g%% of map output, %g flops/byte", 100 * config.combiner_ratio, config.combiner_cost);
+    if (config.compress_ratio < 1.0)
+	XBT_INFO ("map output compression: %g%%, %g MB/s compress, %g MB/s decompress", 100 * config.compress_ratio,
+		config.compress_speed/1024/1024, config.decompress_speed/1024/1024);
+    XBT_INFO ("speculation (LATE): cap %g%%, slow task %g%%, slow node %g%%",
+	    100 * config.speculative_cap, 100 * config.slow_task_threshold, 100 * config.slow_node_threshold);
+    if (user.scheduler_f == fair_scheduler_f)
+    {
+	XBT_INFO ("scheduler: fair (preemption timeout: %gs)", config.preemption_timeout);
+	for (p = 0; p < config.pool_count; p++)
+	{
+	    pool = &config.pools[p];
+	    XBT_INFO ("pool %s: min share %d, weight %g", pool->name, pool->min_share, pool->weight);
+	}
+    }
+    else if (user.scheduler_f == capacity_scheduler_f)
+    {
+	XBT_INFO ("scheduler: capacity");
+	for (p = 0; p < config.pool_count; p++)
+	{
+	    pool = &config.pools[p];
+	    XBT_INFO ("queue %s: capacity %g%%, max capacity %g%%", pool->name, 100 * pool->capacity, 100 * pool->max_capacity);
+	}
+    }
     XBT_INFO (" ");
 }
 
 /** @brief  Print job statistics. */
 static void print_stats (void)
 {
+    double  first_submit;
+    double  last_end = 0.0;
+    double  latency = 0.0;
+    job_t   job;
+    size_t  jid;
+
     XBT_INFO ("JOB STATISTICS:");
     XBT_INFO ("local maps: %d", stats.map_local);
-    XBT_INFO ("non-local maps: %d", stats.map_remote);
+    XBT_INFO ("rack-local maps: %d", stats.map_rack);
+    XBT_INFO ("off-rack maps: %d", stats.map_remote);
     XBT_INFO ("speculative maps (local): %d", stats.map_spec_l);
-    XBT_INFO ("speculative maps (remote): %d", stats.map_spec_r);
-    XBT_INFO ("total non-local maps: %d", stats.map_remote + stats.map_spec_r);
-    XBT_INFO ("total speculative maps: %d", stats.map_spec_l + stats.map_spec_r);
+    XBT_INFO ("speculative maps (rack-local): %d", stats.map_spec_rk);
+    XBT_INFO ("speculative maps (off-rack): %d", stats.map_spec_r);
+    XBT_INFO ("total non-local maps: %d", stats.map_rack + stats.map_remote + stats.map_spec_rk + stats.map_spec_r);
+    XBT_INFO ("total speculative maps: %d", stats.map_spec_l + stats.map_spec_rk + stats.map_spec_r);
     XBT_INFO ("normal reduces: %d", stats.reduce_normal);
     XBT_INFO ("speculative reduces: %d", stats.reduce_spec);
+    if (config.locality_delay > 0 || config.rack_locality_delay > 0)
+	XBT_INFO ("offers skipped for locality: %d", stats.map_skips);
+    if (config.failure_trace != NULL || config.failure_mtbf > 0.0)
+    {
+	XBT_INFO ("lost workers: %d", stats.workers_lost);
+	XBT_INFO ("re-executed maps: %d", stats.maps_reexecuted);
+    }
+    XBT_INFO (" ");
+
+    if (workload.job_count < 2)
+	return;
+
+    XBT_INFO ("WORKLOAD STATISTICS:");
+    first_submit = workload.jobs[0]->submit_time;
+    for (jid = 0; jid < workload.job_count; jid++)
+    {
+	job = workload.jobs[jid];
+	XBT_INFO ("job %zu (%s): submit %.3f, wait %.3f, latency %.3f, local maps %d/%d",
+		job->id, config.pools[job->pool].name, job->submit_time, job->start_time - job->submit_time,
+		job->end_time - job->submit_time,
+		job->stats.map_local + job->stats.map_spec_l, job->amount_of_tasks[MAP]);
+	latency += job->end_time - job->submit_time;
+	if (job->end_time > last_end)
+	    last_end = job->end_time;
+    }
+    XBT_INFO ("average latency: %.3f s", latency / workload.job_count);
+    XBT_INFO ("throughput: %.3f jobs/hour", workload.job_count * 3600.0 / (last_end - first_submit));
     XBT_INFO (" ");
 }
 
 /**
- * @brief  Checks if a worker is a straggler.
- * @param  worker  The worker to be probed.
- * @return 1 if true, 0 if false.
+ * @brief  Write a summary of the run to config.results_file.
+ *
+ * The file has a CSV header and a single row, so the summaries of many runs
+ * can be joined (see MRSG_sweep).
  */
-static int is_straggler (msg_host_t worker)
+static void write_results (void)
 {
-    int     task_count;
-    size_t  wid;
+    double  latency = 0.0;
+    FILE*   file;
+    size_t  jid;
+
+    file = fopen (config.results_file, "w");
+    xbt_assert (file != NULL, "Error writing results file: %s", config.results_file);
+
+    for (jid = 0; jid < workload.job_count; jid++)
+	latency += workload.jobs[jid]->end_time - workload.jobs[jid]->submit_time;
+
+    fprintf (file, "makespan,jobs,average_latency,throughput,local_maps,rack_maps,offrack_maps,"
+	    "speculative_maps,normal_reduces,speculative_reduces,map_skips\n");
+    fprintf (file, "%.3f,%zu,%.3f,%.3f,%d,%d,%d,%d,%d,%d,%d\n",
+	    sim_clock (), workload.job_count, latency / workload.job_count,
+	    workload.job_count * 3600.0 / (sim_clock () - workload.jobs[0]->submit_time),
+	    stats.map_local, stats.map_rack, stats.map_remote,
+	    stats.map_spec_l + stats.map_spec_rk + stats.map_spec_r,
+	    stats.reduce_normal, stats.reduce_spec, stats.map_skips);
+
+    fclose (file);
+}
+
+/**
+ * @brief  Ask the scheduler for a task and send it to a worker.
+ * @param  phase  MAP or REDUCE.
+ * @param  wid    Worker id.
+ * @return 1 if a task was sent, 0 otherwise.
+ *
+ * The running jobs are offered to the scheduler in submission order (FIFO).
+ */
+static int send_scheduler_task (enum phase_e phase, size_t wid)
+{
+    enum task_type_e task_type;
+    job_t            job = NULL;
+    size_t           j;
+    size_t           sid = NONE;
+    size_t           tid = NONE;
+
+    for (j = 0; j < workload.active_count && tid == NONE; j++)
+    {
+	job = workload.active[j];
+	tid = user.scheduler_f (job->id, phase, wid);
+    }
 
-    wid = get_worker_id (worker);
+    if (tid == NONE)
+    {
+	return 0;
+    }
 
-    task_count = (config.slots[MAP] + config.slots[REDUCE]) - (job.heartbeats[wid].slots_av[MAP] + job.heartbeats[wid].slots_av[REDUCE]);
+    task_type = get_task_type (job, phase, tid, wid);
 
-    if (MSG_get_host_speed (worker) < config.grid_average_speed && task_count > 0)
-	return 1;
+    if (task_type == LOCAL || task_type == LOCAL_SPEC)
+    {
+	sid = wid;
+    }
+    else if (task_type == RACK || task_type == RACK_SPEC
+	    || task_type == REMOTE || task_type == REMOTE_SPEC)
+    {
+	sid = find_closest_chunk_owner (job, tid, wid);
 
-    return 0;
+	/* A map can't run while its replicas are on lost workers. */
+	if (sid == NONE)
+	    return 0;
+    }
+
+    XBT_INFO ("job %zu %s %zu assigned to %s %s", job->id, (phase==MAP?"map":"reduce"), tid,
+	    MSG_host_get_name (config.workers[wid]),
+	    task_type_string (task_type));
+
+    send_task (job, phase, tid, sid, wid);
+
+    update_stats (job, task_type);
+
+    return 1;
 }
 
-/**
- * @brief  Returns for how long a task is running.
- * @param  task  The task to be probed.
- * @return The amount of seconds since the beginning of the computation.
- */
-static int task_time_elapsed (msg_task_t task)
+static void init_ready_workers (void)
 {
-    task_info_t  ti;
+    int  phase;
 
-    ti = (task_info_t) MSG_task_get_data (task);
+    for (phase = MAP; phase <= REDUCE; phase++)
+    {
+	ready[phase] = xbt_new (size_t, config.number_of_workers);
+	is_ready[phase] = xbt_new0 (char, config.number_of_workers);
+	ready_head[phase] = 0;
+	ready_count[phase] = 0;
+    }
+}
 
-    return (MSG_task_get_compute_duration (task) - MSG_task_get_remaining_computation (task))
-	/ MSG_get_host_speed (config.workers[ti->wid]);
+static void free_ready_workers (void)
+{
+    int  phase;
+
+    for (phase = MAP; phase <= REDUCE; phase++)
+    {
+	xbt_free_ref (&ready[phase]);
+	xbt_free_ref (&is_ready[phase]);
+    }
 }
 
 /**
- * @brief  Mark the tasks of a straggler as possible speculative tasks.
- * @param  worker  The straggler worker.
+ * @brief  Queue a worker for every phase that has room in it.
+ * @param  wid  Worker id.
  */
-static void set_speculative_tasks (msg_host_t worker)
+static void push_ready_worker (size_t wid)
 {
-    size_t       tid;
-    size_t       wid;
-    task_info_t  ti;
-
-    wid = get_worker_id (worker);
+    int  phase;
 
-    if (job.heartbeats[wid].slots_av[MAP] < config.slots[MAP])
+    for (phase = MAP; phase <= REDUCE; phase++)
     {
-	for (tid = 0; tid < config.amount_of_tasks[MAP]; tid++)
+	if (task_fits (&workload.heartbeats[wid], phase) && !is_ready[phase][wid])
 	{
-	    if (job.task_list[MAP][tid][0] != NULL)
-	    {
-		ti = (task_info_t) MSG_task_get_data (job.task_list[MAP][tid][0]);
-		if (ti->wid == wid && task_time_elapsed (job.task_list[MAP][tid][0]) > 60)
-		{
-		    job.task_status[MAP][tid] = T_STATUS_TIP_SLOW;
-		}
-	    }
+	    ready[phase][(ready_head[phase] + ready_count[phase]) % config.number_of_workers] = wid;
+	    ready_count[phase]++;
+	    is_ready[phase][wid] = 1;
 	}
     }
+}
 
-    if (job.heartbeats[wid].slots_av[REDUCE] < config.slots[REDUCE])
+/**
+ * @brief  Fill the free slots of the queued workers.
+ *
+ * Without delay scheduling, the scheduler never refuses a pending task to
+ * one worker and gives it to another, so the assignment of a phase stops
+ * at the first worker that gets nothing. With delay scheduling, maps are
+ * refused to workers without local data, so those workers stay queued and
+ * the next ones are offered the slot. Every queued worker gets at most one
+ * offer per call, as with one heartbeat.
+ */
+static void assign_ready_workers (void)
+{
+    int     phase;
+    size_t  offers;
+    size_t  wid;
+
+    for (phase = MAP; phase <= REDUCE; phase++)
     {
-	for (tid = 0; tid < config.amount_of_tasks[REDUCE]; tid++)
+	for (offers = ready_count[phase]; offers > 0 && ready_count[phase] > 0; offers--)
 	{
-	    if (job.task_list[REDUCE][tid][0] != NULL)
+	    wid = ready[phase][ready_head[phase]];
+
+	    if (task_fits (&workload.heartbeats[wid], phase))
 	    {
-		ti = (task_info_t) MSG_task_get_data (job.task_list[REDUCE][tid][0]);
-		if (ti->wid == wid && task_time_elapsed (job.task_list[REDUCE][tid][0]) > 60)
+		if (send_scheduler_task (phase, wid))
 		{
-		    job.task_status[REDUCE][tid] = T_STATUS_TIP_SLOW;
+		    if (task_fits (&workload.heartbeats[wid], phase))
+			offers++;
+		    else
+			pop_ready_worker (phase);
+		    continue;
 		}
+
+		if (phase == REDUCE || (config.locality_delay == 0 && config.rack_locality_delay == 0))
+		    break;
+
+		/* Move the worker to the end of the queue. */
+		ready_head[phase] = (ready_head[phase] + 1) % config.number_of_workers;
+		ready[phase][(ready_head[phase] + ready_count[phase] - 1) % config.number_of_workers] = wid;
+		continue;
 	    }
+
+	    pop_ready_worker (phase);
 	}
     }
 }
 
-static void send_scheduler_task (enum phase_e phase, size_t wid)
+/**
+ * @brief  Remove the first worker of a ready queue.
+ * @param  phase  MAP or REDUCE.
+ */
+static void pop_ready_worker (int phase)
 {
-    size_t tid = user.scheduler_f (phase, wid);
-
-    if (tid == NONE)
-    {
-	return;
-    }
-
-    enum task_type_e task_type = get_task_type (phase, tid, wid);
-    size_t	     sid = NONE;
-
-    if (task_type == LOCAL || task_type == LOCAL_SPEC)
-    {
-	sid = wid;
-    }
-    else if (task_type == REMOTE || task_type == REMOTE_SPEC)
-    {
-	sid = find_random_chunk_owner (tid);
-    }
-
-    XBT_INFO ("%s %zu assigned to %s %s", (phase==MAP?"map":"reduce"), tid,
-	    MSG_host_get_name (config.workers[wid]),
-	    task_type_string (task_type));
-
-    send_task (phase, tid, sid, wid);
-
-    update_stats (task_type);
+    is_ready[phase][ready[phase][ready_head[phase]]] = 0;
+    ready_head[phase] = (ready_head[phase] + 1) % config.number_of_workers;
+    ready_count[phase]--;
 }
 
-enum task_type_e get_task_type (enum phase_e phase, size_t tid, size_t wid)
+enum task_type_e get_task_type (job_t job, enum phase_e phase, size_t tid, size_t wid)
 {
-    enum task_status_e task_status = job.task_status[phase][tid];
+    enum task_status_e task_status = job->task_status[phase][tid];
 
     switch (phase)
     {
@@ -264,10 +617,14 @@ enum task_type_e get_task_type (enum phase_e phase, size_t tid, size_t wid)
 	    switch (task_status)
 	    {
 		case T_STATUS_PENDING:
-		    return chunk_owner[tid][wid]? LOCAL : REMOTE;
+		    if (chunk_is_local (job, tid, wid))
+			return LOCAL;
+		    return chunk_is_rack_local (job, tid, wid)? RACK : REMOTE;
 
 		case T_STATUS_TIP_SLOW:
-		    return chunk_owner[tid][wid]? LOCAL_SPEC : REMOTE_SPEC;
+		    if (chunk_is_local (job, tid, wid))
+			return LOCAL_SPEC;
+		    return chunk_is_rack_local (job, tid, wid)? RACK_SPEC : REMOTE_SPEC;
 
 		default:
 		    return NO_TASK;
@@ -293,86 +650,225 @@ enum task_type_e get_task_type (enum phase_e phase, size_t tid, size_t wid)
 
 /**
  * @brief  Send a task to a worker.
+ * @param  job       The job of the task.
  * @param  phase     The current job phase.
  * @param  tid       The task ID.
  * @param  data_src  The ID of the DataNode that owns the task data.
  * @param  wid       The destination worker id.
  */
-static void send_task (enum phase_e phase, size_t tid, size_t data_src, size_t wid)
+static void send_task (job_t job, enum phase_e phase, size_t tid, size_t data_src, size_t wid)
 {
-    char         mailbox[MAILBOX_ALIAS_SIZE];
     int          i;
     double       cpu_required = 0.0;
+    msg_error_t  status;
     msg_task_t   task = NULL;
     task_info_t  task_info;
 
-    cpu_required = user.task_cost_f (phase, tid, wid);
+    cpu_required = task_cost (job, phase, tid, wid);
 
-    task_info = xbt_new (struct task_info_s, 1);
-    task = MSG_task_create (SMS_TASK, cpu_required, 0.0, (void*) task_info);
+    task_info = (task_info_t) obj_pool_get (&obj_pools.task_infos);
+    task = MSG_task_create (message_name (SMS_TASK), cpu_required, 0.0, (void*) task_info);
 
+    task_info->kind = SMS_TASK;
+    task_info->job = job;
     task_info->phase = phase;
     task_info->id = tid;
     task_info->src = data_src;
     task_info->wid = wid;
     task_info->task = task;
+    task_info->start_time = sim_clock ();
     task_info->shuffle_end = 0.0;
+    task_info->killed = 0;
+    task_info->lost = 0;
+    task_info->refs = 2;
 
     // for tracing purposes...
-    MSG_task_set_category (task, (phase==MAP?"MAP":"REDUCE"));
+    if (config.trace_level == MRSG_TRACE_FULL)
+	MSG_task_set_category (task, (phase==MAP?"MAP":"REDUCE"));
+
+    if (job->start_time < 0.0)
+	job->start_time = sim_clock ();
+
+    if (job->task_status[phase][tid] != T_STATUS_TIP_SLOW)
+	job->task_status[phase][tid] = T_STATUS_TIP;
 
-    if (job.task_status[phase][tid] != T_STATUS_TIP_SLOW)
-	job.task_status[phase][tid] = T_STATUS_TIP;
+    acquire_resources (&workload.heartbeats[wid], phase);
 
-    job.heartbeats[wid].slots_av[phase]--;
+    task_started (task_info);
 
     for (i = 0; i < MAX_SPECULATIVE_COPIES; i++)
     {
-	if (job.task_list[phase][tid][i] == NULL)
+	if (job->task_list[phase][tid][i] == NULL)
 	{
-	    job.task_list[phase][tid][i] = task;
+	    job->task_list[phase][tid][i] = task;
 	    break;
 	}
     }
 
-    fprintf (tasks_log, "%d_%zu_%d,%s,%zu,%.3f,START,\n", phase, tid, i, (phase==MAP?"MAP":"REDUCE"), wid, MSG_get_clock ());
+    trace_task_event (job->id, phase, tid, i, wid, EV_START, sim_clock (), 0.0);
 
 #ifdef VERBOSE
-    XBT_INFO ("TX: %s > %s", SMS_TASK, MSG_host_get_name (config.workers[wid]));
+    XBT_INFO ("TX: %s > %s", message_name (SMS_TASK), MSG_host_get_name (config.workers[wid]));
 #endif
 
-    sprintf (mailbox, TASKTRACKER_MAILBOX, wid);
-    xbt_assert (MSG_task_send (task, mailbox) == MSG_OK, "ERROR SENDING MESSAGE");
+    status = MSG_task_send (task, get_worker_info (wid)->tasktracker);
+
+    /* The worker failed during the send, which the injector cancelled.
+     * The copy never reaches it, so drop the reference of the worker, and
+     * leave the copy running until the worker is lost (see worker_lost). */
+    xbt_assert (status == MSG_OK || task_info->lost, "ERROR SENDING MESSAGE");
+    if (status != MSG_OK)
+	release_task_info (task_info);
+
+    job->task_instances[phase][tid]++;
+    count_running (job, phase, 1);
+
+    if (phase == MAP)
+	update_locality_index (job, tid);
+}
+
+/**
+ * @brief  Update the running task counts of a job and of its pool.
+ * @param  job    The job.
+ * @param  phase  MAP or REDUCE.
+ * @param  delta  Tasks started (positive) or finished (negative).
+ */
+static void count_running (job_t job, enum phase_e phase, int delta)
+{
+    job->running[phase] += delta;
+    config.pools[job->pool].running[phase] += delta;
+}
+
+/**
+ * @brief  Kill tasks of the pools above their fair share, for the starved pools.
+ */
+static void preempt_tasks (void)
+{
+    int     needed;
+    int     phase;
+    job_t   victim;
 
-    job.task_instances[phase][tid]++;
+    for (phase = MAP; phase <= REDUCE; phase++)
+    {
+	for (needed = fair_preemption_needed (phase); needed > 0; needed--)
+	{
+	    victim = fair_preemption_victim (phase);
+	    if (victim == NULL || !kill_newest_task (victim, phase))
+		break;
+	}
+    }
 }
 
-static void update_stats (enum task_type_e task_type)
+/**
+ * @brief  Kill the most recently launched task copy of a job.
+ * @param  job    The job.
+ * @param  phase  MAP or REDUCE.
+ * @return 1 if a copy was killed, 0 otherwise.
+ */
+static int kill_newest_task (job_t job, enum phase_e phase)
+{
+    int          i;
+    int          copies;
+    int          newest_i = 0;
+    size_t       newest_tid = NONE;
+    size_t       tid;
+    task_info_t  ti;
+    task_info_t  newest = NULL;
+
+    for (tid = 0; tid < job->amount_of_tasks[phase]; tid++)
+    {
+	if (job->task_status[phase][tid] == T_STATUS_DONE)
+	    continue;
+
+	for (i = 0; i < MAX_SPECULATIVE_COPIES; i++)
+	{
+	    if (job->task_list[phase][tid][i] == NULL)
+		continue;
+
+	    ti = (task_info_t) MSG_task_get_data (job->task_list[phase][tid][i]);
+	    if (newest == NULL || ti->start_time >= newest->start_time)
+	    {
+		newest = ti;
+		newest_tid = tid;
+		newest_i = i;
+	    }
+	}
+    }
+
+    if (newest == NULL)
+	return 0;
+
+    XBT_INFO ("job %zu %s %zu preempted on %s", job->id, (phase==MAP?"map":"reduce"), newest_tid,
+	    MSG_host_get_name (config.workers[newest->wid]));
+
+    newest->killed = 1;
+    task_stopped (newest);
+    MSG_task_cancel (newest->task);
+    job->task_list[phase][newest_tid][newest_i] = NULL;
+    job->task_instances[phase][newest_tid]--;
+    count_running (job, phase, -1);
+    trace_task_event (job->id, phase, newest_tid, newest_i, newest->wid, EV_KILL, sim_clock (), 0.0);
+
+    /* The task runs again if no other copy is running. */
+    for (copies = 0, i = 0; i < MAX_SPECULATIVE_COPIES; i++)
+	if (job->task_list[phase][newest_tid][i] != NULL)
+	    copies++;
+
+    if (copies == 0)
+    {
+	job->task_status[phase][newest_tid] = T_STATUS_PENDING;
+	if (phase == MAP)
+	    update_locality_index (job, newest_tid);
+    }
+
+    return 1;
+}
+
+/**
+ * @brief  Count an assigned task in the job and in the global statistics.
+ * @param  job        The job of the task.
+ * @param  task_type  The assignment type.
+ */
+static void update_stats (job_t job, enum task_type_e task_type)
+{
+    count_task (&job->stats, task_type);
+    count_task (&stats, task_type);
+}
+
+static void count_task (struct stats_s* st, enum task_type_e task_type)
 {
     switch (task_type)
     {
 	case LOCAL:
-	    stats.map_local++;
+	    st->map_local++;
+	    break;
+
+	case RACK:
+	    st->map_rack++;
 	    break;
 
 	case REMOTE:
-	    stats.map_remote++;
+	    st->map_remote++;
 	    break;
 
 	case LOCAL_SPEC:
-	    stats.map_spec_l++;
+	    st->map_spec_l++;
+	    break;
+
+	case RACK_SPEC:
+	    st->map_spec_rk++;
 	    break;
 
 	case REMOTE_SPEC:
-	    stats.map_spec_r++;
+	    st->map_spec_r++;
 	    break;
 
 	case NORMAL:
-	    stats.reduce_normal++;
+	    st->reduce_normal++;
 	    break;
 
 	case SPECULATIVE:
-	    stats.reduce_spec++;
+	    st->reduce_spec++;
 	    break;
 
 	default:
@@ -384,15 +880,21 @@ char* task_type_string (enum task_type_e task_type)
 {
     switch (task_type)
     {
+	case RACK:
+	    return "(rack-local)";
+
 	case REMOTE:
-	    return "(non-local)";
+	    return "(off-rack)";
 
 	case LOCAL_SPEC:
 	case SPECULATIVE:
 	    return "(speculative)";
 
+	case RACK_SPEC:
+	    return "(rack-local, speculative)";
+
 	case REMOTE_SPEC:
-	    return "(non-local, speculative)";
+	    return "(off-rack, speculative)";
 
 	default:
 	    return "";
@@ -405,20 +907,206 @@ char* task_type_string (enum task_type_e task_type)
  */
 static void finish_all_task_copies (task_info_t ti)
 {
-    int     i;
-    int     phase = ti->phase;
-    size_t  tid = ti->id;
+    int          i;
+    int          phase = ti->phase;
+    job_t        job = ti->job;
+    size_t       tid = ti->id;
+    task_info_t  copy;
 
     for (i = 0; i < MAX_SPECULATIVE_COPIES; i++)
     {
-	if (job.task_list[phase][tid][i] != NULL)
+	if (job->task_list[phase][tid][i] != NULL)
+	{
+	    /* The other copies are discounted now, as preempted ones, since
+	     * their worker may be lost before they report. */
+	    copy = (task_info_t) MSG_task_get_data (job->task_list[phase][tid][i]);
+	    if (copy != ti)
+	    {
+		copy->killed = 1;
+		task_stopped (copy);
+		count_running (job, phase, -1);
+	    }
+	    /* Destroyed when the copy reports its completion. */
+	    MSG_task_cancel (job->task_list[phase][tid][i]);
+	    job->task_list[phase][tid][i] = NULL;
+	    trace_task_event (job->id, phase, tid, i, ti->wid, EV_END, sim_clock (), ti->shuffle_end);
+	}
+    }
+}
+
+/**
+ * @brief  Check if a worker may get tasks.
+ * @param  wid  Worker id.
+ * @return 0 if the worker is lost or blacklisted.
+ */
+static int worker_usable (size_t wid)
+{
+    return !workload.lost[wid] && workload.failures[wid] < MAXIMUM_WORKER_FAILURES;
+}
+
+/**
+ * @brief  Declare lost the workers that are silent for too long.
+ *
+ * Runs every third of the timeout, as the JobTracker's expiry thread.
+ */
+static void expire_workers (void)
+{
+    size_t  wid;
+
+    for (wid = 0; wid < config.number_of_workers; wid++)
+    {
+	if (!workload.lost[wid] && sim_clock () - workload.last_seen[wid] > config.heartbeat_timeout)
+	    worker_lost (wid);
+    }
+
+    workload.next_expiry = sim_clock () + config.heartbeat_timeout / 3;
+}
+
+/**
+ * @brief  Forget everything that a failed worker had.
+ * @param  wid  Worker id.
+ *
+ * Its task copies are lost, and so are its replicas until it comes back.
+ * The completed maps whose output was on it run again, if a reduce of
+ * their job is not done.
+ */
+static void worker_lost (size_t wid)
+{
+    job_t         job;
+    shuffle_t     sh;
+    size_t        j;
+    size_t        mid;
+    size_t        rid;
+    task_info_t*  tasks;
+    task_info_t   ti;
+    int           i;
+
+    XBT_INFO ("worker %s lost", MSG_host_get_name (config.workers[wid]));
+
+    workload.lost[wid] = 1;
+    workload.failures[wid]++;
+    memset (&workload.heartbeats[wid], 0, sizeof (struct resources_s));
+    stats.workers_lost++;
+
+    /* The running set holds every copy not reported yet, killed or not. */
+    while (running_tasks (wid, &tasks) > 0)
+    {
+	ti = tasks[0];
+	i = find_task_copy (ti);
+	if (i >= 0)
+	    lose_task_copy (ti, i);
+	task_finished (ti, 0);
+	ti->lost = 1;
+	release_task_info (ti);
+    }
+
+    for (j = 0; j < workload.active_count; j++)
+    {
+	job = workload.active[j];
+
+	if (job->tasks_pending[REDUCE] > 0)
 	{
-	    MSG_task_cancel (job.task_list[phase][tid][i]);
-	    //FIXME: MSG_task_destroy (job.task_list[phase][tid][i]);
-	    job.task_list[phase][tid][i] = NULL;
-	    fprintf (tasks_log, "%d_%zu_%d,%s,%zu,%.3f,END,%.3f\n", ti->phase, tid, i, (ti->phase==MAP?"MAP":"REDUCE"), ti->wid, MSG_get_clock (), ti->shuffle_end);
+	    for (mid = 0; mid < job->amount_of_tasks[MAP]; mid++)
+	    {
+		if (job->task_status[MAP][mid] == T_STATUS_DONE && job->map_worker[mid] == wid)
+		{
+		    job->task_status[MAP][mid] = T_STATUS_PENDING;
+		    job->task_instances[MAP][mid] = 0;
+		    job->tasks_pending[MAP]++;
+		    stats.maps_reexecuted++;
+		}
+	    }
+
+	    /* The running reduces copy the new output of those maps in
+	     * full, even the part that they had already copied. */
+	    for (rid = 0; rid < job->amount_of_tasks[REDUCE]; rid++)
+	    {
+		for (sh = job->shuffles[rid]; sh != NULL; sh = sh->next)
+		{
+		    sh->must_copy += sh->copied[wid];
+		    sh->copied[wid] = 0;
+		}
+	    }
 	}
+
+	memset (job->map_output[wid], 0, job->amount_of_tasks[REDUCE] * sizeof (uint64_t));
+
+	update_replicas (job);
+	reset_locality_index (job);
+    }
+}
+
+/**
+ * @brief  Take back a worker that restarted after a failure.
+ * @param  wid  Worker id.
+ *
+ * A worker lost MAXIMUM_WORKER_FAILURES times gets no more tasks, but its
+ * replicas can still be read.
+ */
+static void worker_recovered (size_t wid)
+{
+    size_t  j;
+
+    workload.lost[wid] = 0;
+
+    for (j = 0; j < workload.active_count; j++)
+    {
+	update_replicas (workload.active[j]);
+	reset_locality_index (workload.active[j]);
     }
+
+    if (workload.failures[wid] >= MAXIMUM_WORKER_FAILURES)
+    {
+	XBT_INFO ("worker %s blacklisted", MSG_host_get_name (config.workers[wid]));
+	return;
+    }
+
+    workload.heartbeats[wid] = config.capacity[wid];
+}
+
+/**
+ * @brief  Find a task copy in the copies of its task.
+ * @param  ti  The task information of the copy.
+ * @return The position of the copy, or -1 if it was killed or finished.
+ */
+static int find_task_copy (task_info_t ti)
+{
+    int  i;
+
+    for (i = 0; i < MAX_SPECULATIVE_COPIES; i++)
+    {
+	if (ti->job->task_list[ti->phase][ti->id][i] == ti->task)
+	    return i;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief  Drop a running copy whose worker failed.
+ * @param  ti  The task information of the copy.
+ * @param  i   The position of the copy.
+ */
+static void lose_task_copy (task_info_t ti, int i)
+{
+    int     copies;
+    job_t   job = ti->job;
+
+    job->task_list[ti->phase][ti->id][i] = NULL;
+    job->task_instances[ti->phase][ti->id]--;
+    count_running (job, ti->phase, -1);
+    trace_task_event (job->id, ti->phase, ti->id, i, ti->wid, EV_KILL, sim_clock (), 0.0);
+
+    /* The task runs again if no other copy is running. */
+    for (copies = 0, i = 0; i < MAX_SPECULATIVE_COPIES; i++)
+	if (job->task_list[ti->phase][ti->id][i] != NULL)
+	    copies++;
+
+    if (copies == 0)
+	job->task_status[ti->phase][ti->id] = T_STATUS_PENDING;
+
+    if (ti->phase == MAP)
+	update_locality_index (job, ti->id);
 }
 
 // vim: set ts=8 sw=4:
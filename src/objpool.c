@@ -0,0 +1,109 @@
+/* Copyright (c) 2012. MRSG Team. All rights reserved. */
+
+/* This file is part of MRSG.
+
+MRSG is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+MRSG is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <string.h>
+#include <xbt/sysdep.h>
+#include <xbt/log.h>
+#include "objpool.h"
+
+XBT_LOG_EXTERNAL_DEFAULT_CATEGORY (msg_test);
+
+/* Objects and slab headers are kept aligned to this size. */
+#define OBJ_POOL_ALIGN 16
+
+struct obj_pools_s  obj_pools;
+
+static void add_slab (struct obj_pool_s* pool);
+
+void init_obj_pool (struct obj_pool_s* pool, const char* name, size_t size)
+{
+    memset (pool, 0, sizeof (struct obj_pool_s));
+    pool->name = name;
+    /* The free list is linked through the first word of the objects. */
+    pool->size = (size + OBJ_POOL_ALIGN - 1) / OBJ_POOL_ALIGN * OBJ_POOL_ALIGN;
+}
+
+void free_obj_pool (struct obj_pool_s* pool)
+{
+    void*  slab;
+
+    while (pool->slabs != NULL)
+    {
+	slab = pool->slabs;
+	pool->slabs = *(void**) slab;
+	xbt_free (slab);
+    }
+
+    memset (pool, 0, sizeof (struct obj_pool_s));
+}
+
+void* obj_pool_get (struct obj_pool_s* pool)
+{
+    void*  obj;
+
+    if (pool->free_list == NULL)
+	add_slab (pool);
+
+    obj = pool->free_list;
+    pool->free_list = *(void**) obj;
+    memset (obj, 0, pool->size);
+
+    pool->gets++;
+    pool->in_use++;
+    if (pool->in_use > pool->peak)
+	pool->peak = pool->in_use;
+
+    return obj;
+}
+
+void obj_pool_put (struct obj_pool_s* pool, void* obj)
+{
+    *(void**) obj = pool->free_list;
+    pool->free_list = obj;
+    pool->in_use--;
+}
+
+void print_obj_pool (struct obj_pool_s* pool)
+{
+    XBT_INFO ("POOL %s: %zu gets, %zu allocations, %zu objects in use (peak %zu)",
+	    pool->name, pool->gets, pool->slab_count, pool->in_use, pool->peak);
+}
+
+/**
+ * @brief  Allocate a slab of objects and add them to the free list.
+ * @param  pool  The pool.
+ */
+static void add_slab (struct obj_pool_s* pool)
+{
+    char*   slab;
+    char*   obj;
+    size_t  i;
+
+    slab = xbt_malloc (OBJ_POOL_ALIGN + OBJ_POOL_SLAB * pool->size);
+    *(void**) slab = pool->slabs;
+    pool->slabs = slab;
+    pool->slab_count++;
+
+    for (i = OBJ_POOL_SLAB; i > 0; i--)
+    {
+	obj = slab + OBJ_POOL_ALIGN + (i - 1) * pool->size;
+	*(void**) obj = pool->free_list;
+	pool->free_list = obj;
+    }
+}
+
+// vim: set ts=8 sw=4:
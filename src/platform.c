@@ -0,0 +1,229 @@
+/* Copyright (c) 2012. MRSG Team. All rights reserved. */
+
+/* This file is part of MRSG.
+
+MRSG is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+MRSG is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "common.h"
+#include "platform.h"
+
+int master (int argc, char *argv[]);
+int worker (int argc, char *argv[]);
+
+static int64_t file_mtime (const char* file_name);
+static void write_string (FILE* file, const char* str);
+static char* read_string (FILE* file);
+
+void fill_platform_cache (struct platform_cache_s* cache, const char* platform,
+	const char* deployment, msg_host_t master)
+{
+    size_t  wid;
+
+    free_platform_cache (cache);
+
+    cache->platform = xbt_strdup (platform);
+    cache->deployment = xbt_strdup (deployment);
+    cache->master = master;
+    cache->worker_count = config.number_of_workers;
+    cache->workers = xbt_new (msg_host_t, cache->worker_count);
+    cache->speeds = xbt_new (double, cache->worker_count);
+    cache->worker_rack = xbt_new (size_t, cache->worker_count);
+    cache->rack_count = config.rack_count;
+
+    for (wid = 0; wid < cache->worker_count; wid++)
+    {
+	cache->workers[wid] = config.workers[wid];
+	cache->speeds[wid] = MSG_get_host_speed (config.workers[wid]);
+	cache->worker_rack[wid] = config.worker_rack[wid];
+    }
+}
+
+int platform_cache_has (struct platform_cache_s* cache, const char* platform, const char* deployment)
+{
+    return (cache->platform != NULL
+	    && strcmp (cache->platform, platform) == 0
+	    && strcmp (cache->deployment, deployment) == 0);
+}
+
+void save_platform_cache (struct platform_cache_s* cache, const char* file_name)
+{
+    FILE*     file;
+    int64_t   mtime[2];
+    size_t    wid;
+    uint32_t  count[2];
+    uint32_t  rack;
+
+    file = fopen (file_name, "wb");
+    xbt_assert (file != NULL, "Error writing platform cache: %s", file_name);
+
+    mtime[0] = file_mtime (cache->platform);
+    mtime[1] = file_mtime (cache->deployment);
+    count[0] = cache->worker_count;
+    count[1] = cache->rack_count;
+
+    fwrite (PLATFORM_CACHE_MAGIC, 1, 8, file);
+    fwrite (mtime, sizeof (int64_t), 2, file);
+    fwrite (count, sizeof (uint32_t), 2, file);
+    write_string (file, cache->platform);
+    write_string (file, cache->deployment);
+    write_string (file, MSG_host_get_name (cache->master));
+
+    for (wid = 0; wid < cache->worker_count; wid++)
+    {
+	rack = cache->worker_rack[wid];
+	write_string (file, MSG_host_get_name (cache->workers[wid]));
+	fwrite (&cache->speeds[wid], sizeof (double), 1, file);
+	fwrite (&rack, sizeof (uint32_t), 1, file);
+    }
+
+    fclose (file);
+}
+
+int load_platform_cache (struct platform_cache_s* cache, const char* file_name,
+	const char* platform, const char* deployment)
+{
+    char      magic[8];
+    char*     name;
+    FILE*     file;
+    int       valid;
+    int64_t   mtime[2];
+    size_t    wid;
+    uint32_t  count[2];
+    uint32_t  rack;
+
+    free_platform_cache (cache);
+
+    file = fopen (file_name, "rb");
+    if (file == NULL)
+	return 0;
+
+    valid = (fread (magic, 1, 8, file) == 8
+	    && memcmp (magic, PLATFORM_CACHE_MAGIC, 8) == 0
+	    && fread (mtime, sizeof (int64_t), 2, file) == 2
+	    && fread (count, sizeof (uint32_t), 2, file) == 2
+	    && mtime[0] == file_mtime (platform)
+	    && mtime[1] == file_mtime (deployment));
+
+    if (valid)
+    {
+	cache->platform = read_string (file);
+	cache->deployment = read_string (file);
+	name = read_string (file);
+	valid = (cache->platform != NULL && cache->deployment != NULL && name != NULL
+		&& strcmp (cache->platform, platform) == 0
+		&& strcmp (cache->deployment, deployment) == 0);
+	if (valid)
+	    valid = ((cache->master = MSG_get_host_by_name (name)) != NULL);
+	xbt_free (name);
+    }
+
+    if (valid)
+    {
+	cache->worker_count = count[0];
+	cache->rack_count = count[1];
+	cache->workers = xbt_new (msg_host_t, cache->worker_count);
+	cache->speeds = xbt_new (double, cache->worker_count);
+	cache->worker_rack = xbt_new (size_t, cache->worker_count);
+
+	for (wid = 0; wid < cache->worker_count && valid; wid++)
+	{
+	    name = read_string (file);
+	    valid = (name != NULL
+		    && (cache->workers[wid] = MSG_get_host_by_name (name)) != NULL
+		    && fread (&cache->speeds[wid], sizeof (double), 1, file) == 1
+		    && fread (&rack, sizeof (uint32_t), 1, file) == 1
+		    && rack < cache->rack_count);
+	    cache->worker_rack[wid] = rack;
+	    xbt_free (name);
+	}
+    }
+
+    fclose (file);
+
+    if (!valid)
+	free_platform_cache (cache);
+
+    return valid;
+}
+
+void launch_cached_deployment (struct platform_cache_s* cache)
+{
+    size_t  wid;
+
+    MSG_process_create ("master", master, NULL, cache->master);
+    for (wid = 0; wid < cache->worker_count; wid++)
+	MSG_process_create ("worker", worker, NULL, cache->workers[wid]);
+}
+
+void free_platform_cache (struct platform_cache_s* cache)
+{
+    xbt_free_ref (&cache->platform);
+    xbt_free_ref (&cache->deployment);
+    xbt_free_ref (&cache->workers);
+    xbt_free_ref (&cache->speeds);
+    xbt_free_ref (&cache->worker_rack);
+    cache->master = NULL;
+    cache->worker_count = 0;
+    cache->rack_count = 0;
+}
+
+/**
+ * @brief  Get the modification time of a file, or -1 if it doesn't exist.
+ */
+static int64_t file_mtime (const char* file_name)
+{
+    struct stat  st;
+
+    if (stat (file_name, &st) != 0)
+	return -1;
+
+    return st.st_mtime;
+}
+
+static void write_string (FILE* file, const char* str)
+{
+    uint32_t  length = strlen (str);
+
+    fwrite (&length, sizeof (uint32_t), 1, file);
+    fwrite (str, 1, length, file);
+}
+
+/**
+ * @brief  Read a string written by write_string.
+ * @return The string, to be freed by the caller, or NULL on error.
+ */
+static char* read_string (FILE* file)
+{
+    char*     str;
+    uint32_t  length;
+
+    if (fread (&length, sizeof (uint32_t), 1, file) != 1 || length > FILENAME_MAX)
+	return NULL;
+
+    str = xbt_new (char, length + 1);
+    if (fread (str, 1, length, file) != length)
+    {
+	xbt_free (str);
+	return NULL;
+    }
+    str[length] = '\0';
+
+    return str;
+}
+
+// vim: set ts=8 sw=4:
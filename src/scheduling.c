@@ -15,23 +15,61 @@ GNU General Public License for more details.
 You should have received a copy of the GNU General Public License
 along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
 
+#include <stdlib.h>
+#include <string.h>
 #include "scheduling.h" // get_task_type
+#include "dfs.h"
+#include "speculation.h"
+
+/*
+ * The map locality index of a job is kept in the job structure:
+ * local_next   First entry of each worker's chunk list that may be pending.
+ * rack_next    First entry of each rack's chunk list that may be pending.
+ * remote_next  One past the highest chunk that may be pending and readable.
+ * spec_set     Speculative map candidates (spec_count of them).
+ * spec_pos     Position of each map in spec_set, or NONE.
+ */
+
+static size_t next_local_map (job_t job, size_t wid);
+static size_t next_rack_map (job_t job, size_t rack);
+static size_t next_remote_map (job_t job);
+static size_t next_speculative_map (job_t job, size_t wid);
+static size_t sorted_position (size_t* list, size_t low, size_t high, size_t tid);
+static int reduces_may_start (job_t job);
+static size_t choose_in_order (size_t jid, enum phase_e phase, size_t wid,
+	int (*compare)(const void*, const void*), int (*usable)(job_t));
+static void update_pool_demand (enum phase_e phase);
+static int pool_target (struct pool_s* pool, enum phase_e phase);
+static double pool_fair_share (struct pool_s* pool, enum phase_e phase);
+static int compare_fair (const void* a, const void* b);
+static int compare_capacity (const void* a, const void* b);
+static int below_max_capacity (job_t job);
+
+/* Job order of the last scheduling decision. */
+static job_t*        order;
+static size_t        order_capacity;
+static enum phase_e  order_phase;
+static size_t        chosen_jid;
+static size_t        chosen_tid;
 
 /**
  * @brief  Chooses a map or reduce task and send it to a worker.
+ * @param  jid    The job id.
  * @param  phase  MAP or REDUCE.
- * @param  wid  Worker id.
+ * @param  wid    Worker id.
  * @return Chosen task id.
  */
-size_t default_scheduler_f (enum phase_e phase, size_t wid)
+size_t default_scheduler_f (size_t jid, enum phase_e phase, size_t wid)
 {
+    job_t  job = workload.jobs[jid];
+
     switch (phase)
     {
 	case MAP:
-	    return choose_default_map_task (wid);
+	    return choose_default_map_task (job, wid);
 
 	case REDUCE:
-	    return choose_default_reduce_task (wid);
+	    return choose_default_reduce_task (job, wid);
 
 	default:
 	    return NONE;
@@ -40,70 +78,634 @@ size_t default_scheduler_f (enum phase_e phase, size_t wid)
 
 /**
  * @brief  Choose a map task, and send it to a worker.
+ * @param  job  The job.
  * @param  wid  Worker id.
+ *
+ * Pending local maps come first (lowest chunk ID), then pending rack-local
+ * maps (lowest chunk ID), then pending remote maps (highest chunk ID), then
+ * speculative copies.
+ *
+ * With delay scheduling (config.locality_delay > 0), a job without local
+ * maps for the worker declines the offer, until it has declined
+ * locality_delay offers since its last local map (Zaharia et al., 2010).
+ * Remote maps wait rack_locality_delay more offers.
  */
-size_t choose_default_map_task (size_t wid)
+size_t choose_default_map_task (job_t job, size_t wid)
 {
-    size_t           chunk;
-    size_t           tid = NONE;
-    enum task_type_e task_type, best_task_type = NO_TASK;
+    int     delay = config.locality_delay;
+    size_t  tid;
+
+    if (job->tasks_pending[MAP] <= 0)
+	return NONE;
 
-    if (job.tasks_pending[MAP] <= 0)
+    tid = next_local_map (job, wid);
+
+    if (tid != NONE)
+    {
+	job->skip_count = 0;
 	return tid;
+    }
+
+    tid = next_rack_map (job, config.worker_rack[wid]);
 
-    /* Look for a task for the worker. */
-    for (chunk = 0; chunk < config.chunk_count; chunk++)
+    if (tid == NONE)
     {
-	task_type = get_task_type (MAP, chunk, wid);
+	tid = next_remote_map (job);
+	delay += config.rack_locality_delay;
+    }
 
-	if (task_type == LOCAL)
-	{
-	    tid = chunk;
-	    break;
-	}
-	else if (task_type == REMOTE
-		|| (job.task_instances[MAP][chunk] < 2 // Speculative
-		    && task_type < best_task_type ))   // tasks.
-	{
-	    best_task_type = task_type;
-	    tid = chunk;
-	}
+    if (tid != NONE && job->skip_count < delay)
+    {
+	job->skip_count++;
+	job->stats.map_skips++;
+	stats.map_skips++;
+	return NONE;
     }
 
+    if (tid == NONE)
+	tid = next_speculative_map (job, wid);
+
     return tid;
 }
 
 /**
  * @brief  Choose a reduce task, and send it to a worker.
+ * @param  job  The job.
  * @param  wid  Worker id.
+ *
+ * The pending reduce whose partition has the most map output on the worker
+ * comes first, so less of its input is copied over the network.
  */
-size_t choose_default_reduce_task (size_t wid)
+size_t choose_default_reduce_task (job_t job, size_t wid)
 {
+    double           left;
+    double           max_left = -1.0;
+    int              speculate;
     size_t           t;
     size_t           tid = NONE;
-    enum task_type_e task_type, best_task_type = NO_TASK;
+    size_t           spec_tid = NONE;
+    enum task_type_e task_type;
 
-    if (job.tasks_pending[REDUCE] <= 0 || (float)job.tasks_pending[MAP]/config.amount_of_tasks[MAP] > 0.9)
-	return tid;
+    if (job->tasks_pending[REDUCE] <= 0 || !reduces_may_start (job))
+	return NONE;
+
+    speculate = may_speculate (wid);
 
-    for (t = 0; t < config.amount_of_tasks[REDUCE]; t++)
+    for (t = 0; t < job->amount_of_tasks[REDUCE]; t++)
     {
-	task_type = get_task_type (REDUCE, t, wid);
+	task_type = get_task_type (job, REDUCE, t, wid);
 
 	if (task_type == NORMAL)
 	{
-	    tid = t;
-	    break;
+	    if (tid == NONE || job->map_output[wid][t] > job->map_output[wid][tid])
+		tid = t;
 	}
-	else if (task_type < best_task_type
-		&& job.task_instances[REDUCE][t] < 2)
+	else if (task_type == SPECULATIVE && speculate && tid == NONE
+		&& job->task_instances[REDUCE][t] < 2)
 	{
-	    best_task_type = task_type; // SPECULATIVE
-	    tid = t;
+	    /* LATE: the copy with the longest time to end. */
+	    left = task_time_left (job, REDUCE, t);
+	    if (left > max_left)
+	    {
+		max_left = left;
+		spec_tid = t;
+	    }
 	}
     }
 
-    return tid;
+    return (tid != NONE ? tid : spec_tid);
+}
+
+/**
+ * @brief  Check if the reduces of a job may be launched (slow-start).
+ * @param  job  The job.
+ *
+ * Reduces start when config.reduce_slowstart of the maps are done
+ * (mapred.reduce.slowstart.completed.maps). In adaptive mode, they start
+ * when the remaining maps, at the observed completion rate, would end
+ * before the average reduce could copy its input, at the copy rate
+ * observed so far. The fixed fraction is used until copies are observed.
+ */
+static int reduces_may_start (job_t job)
+{
+    double  copy_rate;
+    double  done;
+    double  map_time_left;
+    double  shuffle_time;
+
+    done = job->amount_of_tasks[MAP] - job->tasks_pending[MAP];
+
+    if (!config.adaptive_slowstart || workload.copy_time <= 0.0 || done == 0)
+	return (done >= config.reduce_slowstart * job->amount_of_tasks[MAP]);
+
+    if (job->tasks_pending[MAP] <= 0)
+	return 1;
+
+    map_time_left = job->tasks_pending[MAP] * (sim_clock () - job->start_time) / done;
+    copy_rate = config.parallel_copies * workload.copy_bytes / workload.copy_time;
+    shuffle_time = (double) job->output.total / job->amount_of_tasks[REDUCE] / copy_rate;
+
+    return (map_time_left <= shuffle_time);
+}
+
+size_t fair_scheduler_f (size_t jid, enum phase_e phase, size_t wid)
+{
+    return choose_in_order (jid, phase, wid, compare_fair, NULL);
+}
+
+size_t capacity_scheduler_f (size_t jid, enum phase_e phase, size_t wid)
+{
+    return choose_in_order (jid, phase, wid, compare_capacity, below_max_capacity);
+}
+
+int fair_preemption_needed (enum phase_e phase)
+{
+    int             needed = 0;
+    int             target;
+    size_t          p;
+    struct pool_s*  pool;
+
+    update_pool_demand (phase);
+
+    for (p = 0; p < config.pool_count; p++)
+    {
+	pool = &config.pools[p];
+	target = pool_target (pool, phase);
+
+	if (pool->running[phase] >= target)
+	{
+	    pool->starved_since[phase] = -1.0;
+	}
+	else if (pool->starved_since[phase] < 0.0)
+	{
+	    pool->starved_since[phase] = sim_clock ();
+	}
+	else if (sim_clock () - pool->starved_since[phase] >= config.preemption_timeout)
+	{
+	    needed += target - pool->running[phase];
+	    /* Give the freed slots a timeout to reach the pool. */
+	    pool->starved_since[phase] = sim_clock ();
+	}
+    }
+
+    return needed;
+}
+
+job_t fair_preemption_victim (enum phase_e phase)
+{
+    double          excess;
+    double          max_excess = 0.0;
+    job_t           job;
+    job_t           victim = NULL;
+    size_t          j;
+    size_t          p;
+    size_t          victim_pool = NONE;
+    struct pool_s*  pool;
+
+    update_pool_demand (phase);
+
+    for (p = 0; p < config.pool_count; p++)
+    {
+	pool = &config.pools[p];
+	excess = pool->running[phase] - pool_fair_share (pool, phase);
+	if (excess >= 1.0 && excess > max_excess)
+	{
+	    max_excess = excess;
+	    victim_pool = p;
+	}
+    }
+
+    if (victim_pool == NONE)
+	return NULL;
+
+    /* The job of the pool with most running tasks, the newest on ties. */
+    for (j = 0; j < workload.active_count; j++)
+    {
+	job = workload.active[j];
+	if (job->pool == victim_pool && job->running[phase] > 0
+		&& (victim == NULL || job->running[phase] >= victim->running[phase]))
+	{
+	    victim = job;
+	}
+    }
+
+    return victim;
+}
+
+void init_locality_index (job_t job)
+{
+    size_t  chunk;
+
+    job->local_next = xbt_new (size_t, config.number_of_workers);
+    job->rack_next = xbt_new (size_t, config.rack_count);
+    reset_locality_index (job);
+
+    job->spec_set = xbt_new (size_t, job->chunk_count);
+    job->spec_pos = xbt_new (size_t, job->chunk_count);
+    job->spec_count = 0;
+    for (chunk = 0; chunk < job->chunk_count; chunk++)
+	job->spec_pos[chunk] = NONE;
+}
+
+void reset_locality_index (job_t job)
+{
+    size_t  rack;
+    size_t  wid;
+
+    /* The chunk lists of the workers come from the DFS. */
+    for (wid = 0; wid < config.number_of_workers; wid++)
+	job->local_next[wid] = job->chunk_owner.worker_start[wid];
+
+    for (rack = 0; rack < config.rack_count; rack++)
+	job->rack_next[rack] = job->chunk_owner.rack_start[rack];
+
+    job->remote_next = job->chunk_count;
+}
+
+void free_locality_index (job_t job)
+{
+    xbt_free_ref (&job->local_next);
+    xbt_free_ref (&job->rack_next);
+    xbt_free_ref (&job->spec_set);
+    xbt_free_ref (&job->spec_pos);
+}
+
+void update_locality_index (job_t job, size_t tid)
+{
+    int                   candidate;
+    size_t                i;
+    size_t                pos;
+    size_t                rack;
+    size_t                wid;
+    struct chunk_owner_s* chunk_owner = &job->chunk_owner;
+
+    if (job->task_status[MAP][tid] == T_STATUS_PENDING)
+    {
+	/* The map is pending again, so the cursors must not be past it. */
+	for (i = chunk_owner->chunk_start[tid]; i < chunk_owner->chunk_start[tid + 1]; i++)
+	{
+	    wid = chunk_owner->owner[i];
+	    pos = sorted_position (chunk_owner->chunk, chunk_owner->worker_start[wid], chunk_owner->worker_start[wid + 1], tid);
+	    if (pos < job->local_next[wid])
+		job->local_next[wid] = pos;
+
+	    rack = config.worker_rack[wid];
+	    pos = sorted_position (chunk_owner->rack_chunk, chunk_owner->rack_start[rack], chunk_owner->rack_start[rack + 1], tid);
+	    if (pos < job->rack_next[rack])
+		job->rack_next[rack] = pos;
+	}
+
+	if (tid >= job->remote_next)
+	    job->remote_next = tid + 1;
+    }
+
+    candidate = (job->task_status[MAP][tid] == T_STATUS_TIP_SLOW
+	    && job->task_instances[MAP][tid] < 2);
+
+    if (candidate && job->spec_pos[tid] == NONE)
+    {
+	job->spec_pos[tid] = job->spec_count;
+	job->spec_set[job->spec_count++] = tid;
+    }
+    else if (!candidate && job->spec_pos[tid] != NONE)
+    {
+	/* Move the last candidate to the free position. */
+	pos = job->spec_pos[tid];
+	job->spec_set[pos] = job->spec_set[--job->spec_count];
+	job->spec_pos[job->spec_set[pos]] = pos;
+	job->spec_pos[tid] = NONE;
+    }
+}
+
+/**
+ * @brief  Find the lowest pending map that is local to a worker.
+ * @param  job  The job.
+ * @param  wid  Worker id.
+ * @return The task id, or NONE.
+ */
+static size_t next_local_map (job_t job, size_t wid)
+{
+    size_t  end = job->chunk_owner.worker_start[wid + 1];
+
+    /* Maps never return to pending without update_locality_index. */
+    while (job->local_next[wid] < end
+	    && job->task_status[MAP][job->chunk_owner.chunk[job->local_next[wid]]] != T_STATUS_PENDING)
+    {
+	job->local_next[wid]++;
+    }
+
+    if (job->local_next[wid] < end)
+	return job->chunk_owner.chunk[job->local_next[wid]];
+
+    return NONE;
+}
+
+/**
+ * @brief  Find the lowest pending map with a replica in a rack.
+ * @param  job   The job.
+ * @param  rack  The rack.
+ * @return The task id, or NONE.
+ */
+static size_t next_rack_map (job_t job, size_t rack)
+{
+    size_t  end = job->chunk_owner.rack_start[rack + 1];
+
+    while (job->rack_next[rack] < end
+	    && job->task_status[MAP][job->chunk_owner.rack_chunk[job->rack_next[rack]]] != T_STATUS_PENDING)
+    {
+	job->rack_next[rack]++;
+    }
+
+    if (job->rack_next[rack] < end)
+	return job->chunk_owner.rack_chunk[job->rack_next[rack]];
+
+    return NONE;
+}
+
+/**
+ * @brief  Find the highest pending map.
+ * @param  job  The job.
+ * @return The task id, or NONE.
+ *
+ * Maps whose replicas are all on lost workers are skipped. The cursor comes
+ * back to them when a worker recovers (see reset_locality_index).
+ */
+static size_t next_remote_map (job_t job)
+{
+    while (job->remote_next > 0
+	    && (job->task_status[MAP][job->remote_next - 1] != T_STATUS_PENDING
+		|| !chunk_is_available (job, job->remote_next - 1)))
+    {
+	job->remote_next--;
+    }
+
+    if (job->remote_next > 0)
+	return job->remote_next - 1;
+
+    return NONE;
+}
+
+/**
+ * @brief  Find the speculative map with the longest time to end (LATE).
+ * @param  job  The job.
+ * @param  wid  Worker id.
+ * @return The task id, or NONE.
+ *
+ * Local maps win ties.
+ */
+static size_t next_speculative_map (job_t job, size_t wid)
+{
+    double  left;
+    double  max_left = -1.0;
+    int     local;
+    int     best_local = 0;
+    size_t  i;
+    size_t  tid;
+    size_t  best = NONE;
+
+    if (job->spec_count == 0 || !may_speculate (wid))
+	return NONE;
+
+    for (i = 0; i < job->spec_count; i++)
+    {
+	tid = job->spec_set[i];
+	if (!chunk_is_available (job, tid))
+	    continue;
+	left = task_time_left (job, MAP, tid);
+	local = chunk_is_local (job, tid, wid);
+	if (left > max_left || (left == max_left && local && !best_local))
+	{
+	    max_left = left;
+	    best_local = local;
+	    best = tid;
+	}
+    }
+
+    return best;
+}
+
+/**
+ * @brief  Offer the running jobs to the default choosers in a given order.
+ * @param  jid      The job offered by the master.
+ * @param  phase    MAP or REDUCE.
+ * @param  wid      Worker id.
+ * @param  compare  Order of the jobs, for qsort.
+ * @param  usable   Filter of the jobs that may get the slot, or NULL.
+ * @return The chosen task id, if it belongs to jid, or NONE.
+ */
+static size_t choose_in_order (size_t jid, enum phase_e phase, size_t wid,
+	int (*compare)(const void*, const void*), int (*usable)(job_t))
+{
+    size_t  j;
+    size_t  tid = NONE;
+
+    if (workload.active_count == 0)
+	return NONE;
+
+    if (jid == workload.active[0]->id)
+    {
+	/* First offer for this slot, so make the choice. */
+	if (order_capacity < workload.active_count)
+	{
+	    order_capacity = workload.job_count;
+	    order = xbt_realloc (order, order_capacity * sizeof (job_t));
+	}
+
+	update_pool_demand (phase);
+	order_phase = phase;
+	memcpy (order, workload.active, workload.active_count * sizeof (job_t));
+	qsort (order, workload.active_count, sizeof (job_t), compare);
+
+	chosen_jid = NONE;
+	chosen_tid = NONE;
+	for (j = 0; j < workload.active_count && tid == NONE; j++)
+	{
+	    if (usable != NULL && !usable (order[j]))
+		continue;
+
+	    if (phase == MAP)
+		tid = choose_default_map_task (order[j], wid);
+	    else
+		tid = choose_default_reduce_task (order[j], wid);
+
+	    if (tid != NONE)
+	    {
+		chosen_jid = order[j]->id;
+		chosen_tid = tid;
+	    }
+	}
+    }
+
+    return (jid == chosen_jid ? chosen_tid : NONE);
+}
+
+/**
+ * @brief  Count the unfinished tasks of the running jobs of each pool.
+ * @param  phase  MAP or REDUCE.
+ */
+static void update_pool_demand (enum phase_e phase)
+{
+    size_t  j;
+    size_t  p;
+
+    for (p = 0; p < config.pool_count; p++)
+	config.pools[p].demand[phase] = 0;
+
+    for (j = 0; j < workload.active_count; j++)
+	config.pools[workload.active[j]->pool].demand[phase] += workload.active[j]->tasks_pending[phase];
+}
+
+/**
+ * @brief  The slots a pool is guaranteed: its minimum share, up to its demand.
+ */
+static int pool_target (struct pool_s* pool, enum phase_e phase)
+{
+    if (pool->min_share < pool->demand[phase])
+	return pool->min_share;
+
+    return pool->demand[phase];
+}
+
+/**
+ * @brief  Approximate fair share of a pool.
+ *
+ * The guaranteed slots, or the weighted share of all the slots among the
+ * pools with demand, whichever is larger, up to the demand of the pool.
+ */
+static double pool_fair_share (struct pool_s* pool, enum phase_e phase)
+{
+    double  share;
+    double  total_weight = 0.0;
+    size_t  p;
+
+    if (pool->demand[phase] == 0)
+	return 0.0;
+
+    for (p = 0; p < config.pool_count; p++)
+	if (config.pools[p].demand[phase] > 0)
+	    total_weight += config.pools[p].weight;
+
+    share = pool->weight / total_weight * config.total_slots[phase];
+    if (share < pool_target (pool, phase))
+	share = pool_target (pool, phase);
+
+    if (share > pool->demand[phase])
+	share = pool->demand[phase];
+
+    return share;
+}
+
+static int compare_fair (const void* a, const void* b)
+{
+    double          ratio_a, ratio_b;
+    int             needy_a, needy_b;
+    job_t           ja = *(const job_t*) a;
+    job_t           jb = *(const job_t*) b;
+    struct pool_s*  pa = &config.pools[ja->pool];
+    struct pool_s*  pb = &config.pools[jb->pool];
+    enum phase_e    phase = order_phase;
+
+    if (ja->pool != jb->pool)
+    {
+	/* Pools below their minimum share come first. */
+	needy_a = pa->running[phase] < pool_target (pa, phase);
+	needy_b = pb->running[phase] < pool_target (pb, phase);
+	if (needy_a != needy_b)
+	    return needy_b - needy_a;
+
+	if (needy_a)
+	{
+	    ratio_a = (double) pa->running[phase] / pool_target (pa, phase);
+	    ratio_b = (double) pb->running[phase] / pool_target (pb, phase);
+	}
+	else
+	{
+	    ratio_a = pa->running[phase] / pa->weight;
+	    ratio_b = pb->running[phase] / pb->weight;
+	}
+
+	if (ratio_a != ratio_b)
+	    return (ratio_a < ratio_b ? -1 : 1);
+
+	return (ja->pool < jb->pool ? -1 : 1);
+    }
+
+    if (ja->running[phase] != jb->running[phase])
+	return ja->running[phase] - jb->running[phase];
+
+    return (ja->id < jb->id ? -1 : 1);
+}
+
+static int compare_capacity (const void* a, const void* b)
+{
+    double          used_a, used_b;
+    job_t           ja = *(const job_t*) a;
+    job_t           jb = *(const job_t*) b;
+    struct pool_s*  pa = &config.pools[ja->pool];
+    struct pool_s*  pb = &config.pools[jb->pool];
+    enum phase_e    phase = order_phase;
+
+    if (ja->pool != jb->pool)
+    {
+	/* Queues without capacity only get the slots that nobody else wants. */
+	if ((pa->capacity > 0.0) != (pb->capacity > 0.0))
+	    return (pa->capacity > 0.0 ? -1 : 1);
+
+	if (pa->capacity > 0.0)
+	{
+	    used_a = pa->running[phase] / pa->capacity;
+	    used_b = pb->running[phase] / pb->capacity;
+	}
+	else
+	{
+	    used_a = pa->running[phase];
+	    used_b = pb->running[phase];
+	}
+
+	if (used_a != used_b)
+	    return (used_a < used_b ? -1 : 1);
+
+	return (ja->pool < jb->pool ? -1 : 1);
+    }
+
+    return (ja->id < jb->id ? -1 : 1);
+}
+
+static int below_max_capacity (job_t job)
+{
+    struct pool_s*  pool = &config.pools[job->pool];
+
+    return pool->running[order_phase] < pool->max_capacity * config.total_slots[order_phase];
+}
+
+/**
+ * @brief  Binary search a map in a sorted chunk list.
+ * @param  list  The chunk list.
+ * @param  low   First position of the search.
+ * @param  high  One past the last position of the search.
+ * @param  tid   Task id.
+ * @return The position of the first chunk not lower than tid.
+ */
+static size_t sorted_position (size_t* list, size_t low, size_t high, size_t tid)
+{
+    size_t  mid;
+
+    while (low < high)
+    {
+	mid = low + (high - low) / 2;
+	if (list[mid] < tid)
+	    low = mid + 1;
+	else
+	    high = mid;
+    }
+
+    return low;
+}
+
+void free_scheduler (void)
+{
+    xbt_free_ref (&order);
+    order_capacity = 0;
 }
 
 // vim: set ts=8 sw=4:
@@ -15,6 +15,7 @@ GNU General Public License for more details.
 You should have received a copy of the GNU General Public License
 along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
 
+#include <stdlib.h>
 #include <msg/msg.h>
 #include <xbt/sysdep.h>
 #include <xbt/log.h>
@@ -23,45 +24,96 @@ along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
 #include "worker.h"
 #include "dfs.h"
 #include "mrsg.h"
+#include "scheduling.h"
+#include "speculation.h"
+#include "platform.h"
+#include "objpool.h"
+#include "costtable.h"
+#include "history.h"
 
 XBT_LOG_NEW_DEFAULT_CATEGORY (msg_test, "MRSG");
 
+/* The state of the current run, and the user functions. */
+struct config_s     config;
+struct stats_s      stats;
+struct workload_s   workload;
+struct mrsg_perf_s  perf;
+struct user_s       user;
+
 #define MAX_LINE_SIZE 256
 
 int master (int argc, char *argv[]);
 int worker (int argc, char *argv[]);
 
-static void check_config (void);
-static msg_error_t run_simulation (const char* platform_file, const char* deploy_file, const char* mr_config_file);
-static void init_mr_config (const char* mr_config_file);
+static void init_simgrid (mrsg_context_t ctx);
+static msg_error_t run_simulation (mrsg_context_t ctx, const char* deploy_file, const char* mr_config_file);
+static void init_mr_config (struct platform_cache_s* cache);
 static void read_mr_config_file (const char* file_name);
-static void init_config (void);
-static void init_job (void);
+static void read_workload_trace (const char* file_name);
+static int compare_submit_time (const void* a, const void* b);
+static void sort_jobs (void);
+static void init_config (struct platform_cache_s* cache);
+static void init_racks (struct platform_cache_s* cache);
+static void init_resources (void);
+static int host_resource (msg_host_t host, const char* property, int amount);
+static void find_racks (msg_as_t as);
+static void init_workload (void);
 static void init_stats (void);
 static void free_global_mem (void);
 
+/* SimGrid can only be initialized, and load a platform, once per process. */
+static char*  loaded_platform = NULL;
+
 int MRSG_main (const char* plat, const char* depl, const char* conf)
 {
-    int argc = 8;
-    char* argv[] = {
-	"mrsg",
-	"--cfg=tracing:1",
-	"--cfg=tracing/buffer:1",
-	"--cfg=tracing/filename:tracefile.trace",
-	"--cfg=tracing/categorized:1",
-	"--cfg=tracing/uncategorized:1",
-	"--cfg=viva/categorized:cat.plist",
-	"--cfg=viva/uncategorized:uncat.plist"
-    };
+    return MRSG_main_args (0, NULL, plat, depl, conf);
+}
+
+int MRSG_main_args (int argc, char* argv[], const char* plat, const char* depl, const char* conf)
+{
+    int             res;
+    mrsg_context_t  ctx;
+
+    ctx = MRSG_context_create (argc, argv, plat);
+    res = MRSG_context_run (ctx, depl, conf);
+    MRSG_context_destroy (ctx);
+
+    return res;
+}
+
+mrsg_context_t MRSG_context_create (int argc, char* argv[], const char* plat)
+{
+    int             i;
+    mrsg_context_t  ctx;
+
+    ctx = xbt_new0 (struct mrsg_context_s, 1);
+    ctx->user = user;
+    ctx->trace_level = config.trace_level;
+    ctx->platform = xbt_strdup (plat);
+    ctx->argc = argc;
+    ctx->argv = xbt_new (char*, argc + 1);
+    for (i = 0; i < argc; i++)
+	ctx->argv[i] = xbt_strdup (argv[i]);
+    ctx->argv[argc] = NULL;
+
+    return ctx;
+}
 
+int MRSG_context_run (mrsg_context_t ctx, const char* depl, const char* conf)
+{
     msg_error_t  res = MSG_OK;
 
+    user = ctx->user;
+    config.trace_level = ctx->trace_level;
     config.initialized = 0;
 
-    check_config ();
+    if (loaded_platform == NULL)
+	init_simgrid (ctx);
+    else
+	xbt_assert (strcmp (loaded_platform, ctx->platform) == 0,
+		"SimGrid can't load a second platform (%s) in the same process", ctx->platform);
 
-    MSG_init (&argc, argv);
-    res = run_simulation (plat, depl, conf);
+    res = run_simulation (ctx, depl, conf);
 
     if (res == MSG_OK)
 	return 0;
@@ -69,37 +121,99 @@ int MRSG_main (const char* plat, const char* depl, const char* conf)
 	return 1;
 }
 
-/**
- * @brief Check if the user configuration is sound.
- */
-static void check_config (void)
+void MRSG_context_set_platform_cache (mrsg_context_t ctx, const char* file)
 {
-    xbt_assert (user.task_cost_f != NULL, "Task cost function not specified.");
-    xbt_assert (user.map_output_f != NULL, "Map output function not specified.");
+    xbt_free_ref (&ctx->cache_file);
+    if (file != NULL)
+	ctx->cache_file = xbt_strdup (file);
+}
+
+void MRSG_context_destroy (mrsg_context_t ctx)
+{
+    int  i;
+
+    free_platform_cache (&ctx->cache);
+    xbt_free_ref (&ctx->cache_file);
+
+    for (i = 0; i < ctx->argc; i++)
+	xbt_free (ctx->argv[i]);
+    xbt_free (ctx->argv);
+    xbt_free (ctx->platform);
+    xbt_free (ctx);
 }
 
 /**
- * @param  platform_file   The path/name of the platform file.
- * @param  deploy_file     The path/name of the deploy file.
- * @param  mr_config_file  The path/name of the configuration file.
+ * @brief  Initialize SimGrid and load the platform of a context.
+ * @param  ctx  The context.
  */
-static msg_error_t run_simulation (const char* platform_file, const char* deploy_file, const char* mr_config_file)
+static void init_simgrid (mrsg_context_t ctx)
 {
-    msg_error_t  res = MSG_OK;
+    char* tracing[] = {
+	"--cfg=tracing:1",
+	"--cfg=tracing/buffer:1",
+	"--cfg=tracing/filename:tracefile.trace",
+	"--cfg=tracing/categorized:1",
+	"--cfg=tracing/uncategorized:1",
+	"--cfg=viva/categorized:cat.plist",
+	"--cfg=viva/uncategorized:uncat.plist"
+    };
+    char**  args;
+    int     count = 0;
+    int     i;
 
-    read_mr_config_file (mr_config_file);
+    /* Program name, tracing options and then the user options. */
+    args = xbt_new (char*, ctx->argc + sizeof (tracing) / sizeof (char*) + 2);
+    args[count++] = (ctx->argc > 0 ? ctx->argv[0] : "mrsg");
+    if (ctx->trace_level == MRSG_TRACE_FULL)
+	for (i = 0; i < sizeof (tracing) / sizeof (char*); i++)
+	    args[count++] = tracing[i];
+    for (i = 1; i < ctx->argc; i++)
+	args[count++] = ctx->argv[i];
+    args[count] = NULL;
+
+    MSG_init (&count, args);
+    xbt_free (args);
 
-    MSG_create_environment (platform_file);
+    MSG_create_environment (ctx->platform);
+    loaded_platform = xbt_strdup (ctx->platform);
 
-    // for tracing purposes..
-    TRACE_category_with_color ("MAP", "1 0 0");
-    TRACE_category_with_color ("REDUCE", "0 0 1");
+    if (ctx->trace_level == MRSG_TRACE_FULL)
+    {
+	TRACE_category_with_color ("MAP", "1 0 0");
+	TRACE_category_with_color ("REDUCE", "0 0 1");
+    }
 
     MSG_function_register ("master", master);
     MSG_function_register ("worker", worker);
-    MSG_launch_application (deploy_file);
+}
 
-    init_mr_config (mr_config_file);
+/**
+ * @param  ctx             The context.
+ * @param  deploy_file     The path/name of the deploy file.
+ * @param  mr_config_file  The path/name of the configuration file.
+ */
+static msg_error_t run_simulation (mrsg_context_t ctx, const char* deploy_file, const char* mr_config_file)
+{
+    msg_error_t              res = MSG_OK;
+    struct platform_cache_s* cache = &ctx->cache;
+
+    read_mr_config_file (mr_config_file);
+
+    if (platform_cache_has (cache, ctx->platform, deploy_file)
+	    || (ctx->cache_file != NULL && load_platform_cache (cache, ctx->cache_file, ctx->platform, deploy_file)))
+    {
+	launch_cached_deployment (cache);
+	init_mr_config (cache);
+    }
+    else
+    {
+	/* Parse the deployment, and find the workers and their racks. */
+	MSG_launch_application (deploy_file);
+	init_mr_config (NULL);
+	fill_platform_cache (cache, ctx->platform, deploy_file, config.master);
+	if (ctx->cache_file != NULL)
+	    save_platform_cache (cache, ctx->cache_file);
+    }
 
     res = MSG_main ();
 
@@ -110,15 +224,15 @@ static msg_error_t run_simulation (const char* platform_file, const char* deploy
 
 /**
  * @brief  Initialize the MapReduce configuration.
- * @param  mr_config_file  The path/name of the configuration file.
+ * @param  cache  The workers of the deployment, or NULL to find them.
  */
-static void init_mr_config (const char* mr_config_file)
+static void init_mr_config (struct platform_cache_s* cache)
 {
-    srand (12345);
-    init_config ();
+    srand (config.seed);
+    init_config (cache);
     init_stats ();
-    init_job ();
-    distribute_data ();
+    init_workload ();
+    init_speculation ();
 }
 
 /**
@@ -128,7 +242,11 @@ static void init_mr_config (const char* mr_config_file)
 static void read_mr_config_file (const char* file_name)
 {
     char    property[256];
+    double  capacity = 0.0;
     FILE*   file;
+    int     io_sort_mb = IO_SORT_MB;
+    size_t  p;
+    struct pool_s* pool;
 
     /* Set the default configuration. */
     config.chunk_size = 67108864;
@@ -137,6 +255,43 @@ static void read_mr_config_file (const char* file_name)
     config.slots[MAP] = 2;
     config.amount_of_tasks[REDUCE] = 1;
     config.slots[REDUCE] = 2;
+    config.resource_model = RM_SLOTS;
+    config.node_resources.amount[RES_MEMORY] = NODE_MEMORY_MB;
+    config.node_resources.amount[RES_VCORES] = NODE_VCORES;
+    config.container[MAP].amount[RES_MEMORY] = CONTAINER_MEMORY_MB;
+    config.container[MAP].amount[RES_VCORES] = CONTAINER_VCORES;
+    config.container[REDUCE] = config.container[MAP];
+    config.heartbeat_mode = HB_POLL;
+    config.keepalive_interval = KEEPALIVE_INTERVAL;
+    config.heartbeat_timeout = 0.0;
+    config.parallel_copies = PARALLEL_COPIES;
+    config.copy_backoff = COPY_BACKOFF;
+    config.workload_trace = NULL;
+    config.job_history = NULL;
+    config.task_trace = xbt_strdup ("tasks.evt");
+    config.results_file = NULL;
+    config.seed = DEFAULT_SEED;
+    config.failure_trace = NULL;
+    config.failure_mtbf = 0.0;
+    config.failure_mttr = 0.0;
+    config.pool_count = 0;
+    config.pools = NULL;
+    config.preemption_timeout = 0.0;
+    config.locality_delay = 0;
+    config.rack_locality_delay = 0;
+    config.speculative_cap = 0.1;
+    config.slow_task_threshold = 0.75;
+    config.slow_node_threshold = 0.25;
+    config.reduce_slowstart = 0.1;
+    config.adaptive_slowstart = 0;
+    config.disk_read_bandwidth = 0.0;
+    config.disk_write_bandwidth = 0.0;
+    config.io_sort_factor = IO_SORT_FACTOR;
+    config.combiner_ratio = 1.0;
+    config.combiner_cost = 0.0;
+    config.compress_ratio = 1.0;
+    config.compress_speed = 0.0;
+    config.decompress_speed = 0.0;
 
     /* Read the user configuration file. */
 
@@ -171,6 +326,234 @@ static void read_mr_config_file (const char* file_name)
 	{
 	    fscanf (file, "%d", &config.slots[REDUCE]);
 	}
+	else if ( strcmp (property, "resource_model") == 0 )
+	{
+	    fscanf (file, "%256s", property);
+	    if ( strcmp (property, "slots") == 0 )
+		config.resource_model = RM_SLOTS;
+	    else if ( strcmp (property, "containers") == 0 )
+		config.resource_model = RM_CONTAINERS;
+	    else
+	    {
+		printf ("Error: Resource model %s is not valid. (in %s)", property, file_name);
+		exit (1);
+	    }
+	}
+	else if ( strcmp (property, "node_resources") == 0 )
+	{
+	    fscanf (file, "%d %d", &config.node_resources.amount[RES_MEMORY], &config.node_resources.amount[RES_VCORES]);
+	}
+	else if ( strcmp (property, "map_container") == 0 )
+	{
+	    fscanf (file, "%d %d", &config.container[MAP].amount[RES_MEMORY], &config.container[MAP].amount[RES_VCORES]);
+	}
+	else if ( strcmp (property, "reduce_container") == 0 )
+	{
+	    fscanf (file, "%d %d", &config.container[REDUCE].amount[RES_MEMORY], &config.container[REDUCE].amount[RES_VCORES]);
+	}
+	else if ( strcmp (property, "heartbeat_mode") == 0 )
+	{
+	    fscanf (file, "%256s", property);
+	    if ( strcmp (property, "poll") == 0 )
+		config.heartbeat_mode = HB_POLL;
+	    else if ( strcmp (property, "push") == 0 )
+		config.heartbeat_mode = HB_PUSH;
+	    else
+	    {
+		printf ("Error: Heartbeat mode %s is not valid. (in %s)", property, file_name);
+		exit (1);
+	    }
+	}
+	else if ( strcmp (property, "keepalive_interval") == 0 )
+	{
+	    fscanf (file, "%d", &config.keepalive_interval);
+	}
+	else if ( strcmp (property, "heartbeat_timeout") == 0 )
+	{
+	    fscanf (file, "%lg", &config.heartbeat_timeout);
+	}
+	else if ( strcmp (property, "reduce_parallel_copies") == 0 )
+	{
+	    fscanf (file, "%d", &config.parallel_copies);
+	}
+	else if ( strcmp (property, "reduce_copy_backoff") == 0 )
+	{
+	    fscanf (file, "%lg", &config.copy_backoff);
+	}
+	else if ( strcmp (property, "workload_trace") == 0 )
+	{
+	    fscanf (file, "%256s", property);
+	    config.workload_trace = xbt_strdup (property);
+	}
+	else if ( strcmp (property, "job_history") == 0 )
+	{
+	    fscanf (file, "%256s", property);
+	    config.job_history = xbt_strdup (property);
+	}
+	else if ( strcmp (property, "task_trace") == 0 )
+	{
+	    fscanf (file, "%256s", property);
+	    xbt_free_ref (&config.task_trace);
+	    if ( strcmp (property, "none") != 0 )
+		config.task_trace = xbt_strdup (property);
+	}
+	else if ( strcmp (property, "results_file") == 0 )
+	{
+	    fscanf (file, "%256s", property);
+	    xbt_free_ref (&config.results_file);
+	    config.results_file = xbt_strdup (property);
+	}
+	else if ( strcmp (property, "seed") == 0 )
+	{
+	    fscanf (file, "%u", &config.seed);
+	}
+	else if ( strcmp (property, "failure_trace") == 0 )
+	{
+	    fscanf (file, "%256s", property);
+	    xbt_free_ref (&config.failure_trace);
+	    if ( strcmp (property, "none") != 0 )
+		config.failure_trace = xbt_strdup (property);
+	}
+	else if ( strcmp (property, "failure_mtbf") == 0 )
+	{
+	    fscanf (file, "%lg %lg", &config.failure_mtbf, &config.failure_mttr);
+	}
+	else if ( strcmp (property, "scheduler") == 0 )
+	{
+	    fscanf (file, "%256s", property);
+	    if ( strcmp (property, "fifo") == 0 )
+		user.scheduler_f = default_scheduler_f;
+	    else if ( strcmp (property, "fair") == 0 )
+		user.scheduler_f = fair_scheduler_f;
+	    else if ( strcmp (property, "capacity") == 0 )
+		user.scheduler_f = capacity_scheduler_f;
+	    else
+	    {
+		printf ("Error: Scheduler %s is not valid. (in %s)", property, file_name);
+		exit (1);
+	    }
+	}
+	else if ( strcmp (property, "pool") == 0 )
+	{
+	    fscanf (file, "%63s", property);
+	    pool = &config.pools[find_pool (property)];
+	    fscanf (file, "%d %lg", &pool->min_share, &pool->weight);
+	}
+	else if ( strcmp (property, "queue") == 0 )
+	{
+	    fscanf (file, "%63s", property);
+	    pool = &config.pools[find_pool (property)];
+	    fscanf (file, "%lg %lg", &pool->capacity, &pool->max_capacity);
+	    pool->capacity /= 100; /* % -> fraction */
+	    pool->max_capacity /= 100;
+	}
+	else if ( strcmp (property, "fair_preemption_timeout") == 0 )
+	{
+	    fscanf (file, "%lg", &config.preemption_timeout);
+	}
+	else if ( strcmp (property, "locality_delay") == 0 )
+	{
+	    fscanf (file, "%d", &config.locality_delay);
+	}
+	else if ( strcmp (property, "rack_locality_delay") == 0 )
+	{
+	    fscanf (file, "%d", &config.rack_locality_delay);
+	}
+	else if ( strcmp (property, "reduce_slowstart") == 0 )
+	{
+	    fscanf (file, "%256s", property);
+	    if ( strcmp (property, "adaptive") == 0 )
+		config.adaptive_slowstart = 1;
+	    else
+		config.reduce_slowstart = atof (property);
+	}
+	else if ( strcmp (property, "speculative_cap") == 0 )
+	{
+	    fscanf (file, "%lg", &config.speculative_cap);
+	    config.speculative_cap /= 100; /* % -> fraction */
+	}
+	else if ( strcmp (property, "slow_task_threshold") == 0 )
+	{
+	    fscanf (file, "%lg", &config.slow_task_threshold);
+	    config.slow_task_threshold /= 100;
+	}
+	else if ( strcmp (property, "slow_node_threshold") == 0 )
+	{
+	    fscanf (file, "%lg", &config.slow_node_threshold);
+	    config.slow_node_threshold /= 100;
+	}
+	else if ( strcmp (property, "disk_read_bandwidth") == 0 )
+	{
+	    fscanf (file, "%lg", &config.disk_read_bandwidth);
+	    config.disk_read_bandwidth *= 1024 * 1024; /* MB/s -> bytes/s */
+	}
+	else if ( strcmp (property, "disk_write_bandwidth") == 0 )
+	{
+	    fscanf (file, "%lg", &config.disk_write_bandwidth);
+	    config.disk_write_bandwidth *= 1024 * 1024;
+	}
+	else if ( strcmp (property, "io_sort_mb") == 0 )
+	{
+	    fscanf (file, "%d", &io_sort_mb);
+	}
+	else if ( strcmp (property, "io_sort_factor") == 0 )
+	{
+	    fscanf (file, "%d", &config.io_sort_factor);
+	}
+	else if ( strcmp (property, "combiner_ratio") == 0 )
+	{
+	    fscanf (file, "%lg", &config.combiner_ratio);
+	}
+	else if ( strcmp (property, "combiner_cost") == 0 )
+	{
+	    fscanf (file, "%lg", &config.combiner_cost);
+	}
+	else if ( strcmp (property, "map_output_codec") == 0 )
+	{
+	    /* Set the codec parameters, later keys may override them. */
+	    fscanf (file, "%256s", property);
+	    if ( strcmp (property, "none") == 0 )
+	    {
+		config.compress_ratio = 1.0;
+	    }
+	    else if ( strcmp (property, "snappy") == 0 )
+	    {
+		config.compress_ratio = SNAPPY_RATIO;
+		config.compress_speed = SNAPPY_COMPRESS * 1024 * 1024;
+		config.decompress_speed = SNAPPY_DECOMPRESS * 1024 * 1024;
+	    }
+	    else if ( strcmp (property, "lzo") == 0 )
+	    {
+		config.compress_ratio = LZO_RATIO;
+		config.compress_speed = LZO_COMPRESS * 1024 * 1024;
+		config.decompress_speed = LZO_DECOMPRESS * 1024 * 1024;
+	    }
+	    else if ( strcmp (property, "gzip") == 0 )
+	    {
+		config.compress_ratio = GZIP_RATIO;
+		config.compress_speed = GZIP_COMPRESS * 1024 * 1024;
+		config.decompress_speed = GZIP_DECOMPRESS * 1024 * 1024;
+	    }
+	    else
+	    {
+		printf ("Error: Codec %s is not valid. (in %s)", property, file_name);
+		exit (1);
+	    }
+	}
+	else if ( strcmp (property, "compress_ratio") == 0 )
+	{
+	    fscanf (file, "%lg", &config.compress_ratio);
+	}
+	else if ( strcmp (property, "compress_speed") == 0 )
+	{
+	    fscanf (file, "%lg", &config.compress_speed);
+	    config.compress_speed *= 1024 * 1024; /* MB/s -> bytes/s */
+	}
+	else if ( strcmp (property, "decompress_speed") == 0 )
+	{
+	    fscanf (file, "%lg", &config.decompress_speed);
+	    config.decompress_speed *= 1024 * 1024;
+	}
 	else
 	{
 	    printf ("Error: Property %s is not valid. (in %s)", property, file_name);
@@ -183,18 +566,248 @@ static void read_mr_config_file (const char* file_name)
     /* Assert the configuration values. */
 
     xbt_assert (config.chunk_size > 0, "Chunk size must be greater than zero");
-    xbt_assert (config.chunk_count > 0, "The amount of input chunks must be greater than zero");
     xbt_assert (config.chunk_replicas > 0, "The amount of chunk replicas must be greater than zero");
     xbt_assert (config.slots[MAP] > 0, "Map slots must be greater than zero");
     xbt_assert (config.amount_of_tasks[REDUCE] >= 0, "The number of reduce tasks can't be negative");
     xbt_assert (config.slots[REDUCE] > 0, "Reduce slots must be greater than zero");
+    xbt_assert (config.node_resources.amount[RES_MEMORY] >= 0 && config.node_resources.amount[RES_VCORES] >= 0,
+	    "Node resources can't be negative");
+    xbt_assert (config.container[MAP].amount[RES_MEMORY] > 0 && config.container[MAP].amount[RES_VCORES] > 0
+	    && config.container[REDUCE].amount[RES_MEMORY] > 0 && config.container[REDUCE].amount[RES_VCORES] > 0,
+	    "Container memory and vcores must be greater than zero");
+    xbt_assert (config.keepalive_interval > 0, "Keepalive interval must be greater than zero");
+    xbt_assert (config.heartbeat_timeout >= 0.0, "Heartbeat timeout can't be negative");
+    xbt_assert (config.failure_mtbf >= 0.0 && config.failure_mttr >= 0.0, "Failure MTBF and MTTR can't be negative");
+    xbt_assert (config.parallel_copies > 0, "Parallel copies must be greater than zero");
+    xbt_assert (config.copy_backoff >= COPY_BACKOFF_INIT, "Copy backoff must be at least %d seconds", COPY_BACKOFF_INIT);
+    xbt_assert (config.preemption_timeout >= 0.0, "Preemption timeout can't be negative");
+    xbt_assert (config.locality_delay >= 0, "Locality delay can't be negative");
+    xbt_assert (config.rack_locality_delay >= 0, "Rack locality delay can't be negative");
+    xbt_assert (config.reduce_slowstart >= 0.0 && config.reduce_slowstart <= 1.0,
+	    "Reduce slow-start must be between 0 and 1");
+    xbt_assert (config.speculative_cap >= 0.0, "Speculative cap can't be negative");
+    xbt_assert (config.slow_task_threshold >= 0.0, "Slow task threshold can't be negative");
+    xbt_assert (config.slow_node_threshold >= 0.0 && config.slow_node_threshold <= 1.0,
+	    "Slow node threshold must be a percentile (0 to 100)");
+    xbt_assert (config.disk_read_bandwidth >= 0.0 && config.disk_write_bandwidth >= 0.0,
+	    "Disk bandwidths can't be negative");
+    xbt_assert ((config.disk_read_bandwidth > 0.0) == (config.disk_write_bandwidth > 0.0),
+	    "Disk read and write bandwidths must be set together");
+    xbt_assert (io_sort_mb > 0, "Sort buffer size must be greater than zero");
+    xbt_assert (config.io_sort_factor > 1, "Sort factor must be greater than one");
+    xbt_assert (config.combiner_ratio > 0.0 && config.combiner_ratio <= 1.0,
+	    "Combiner ratio must be greater than 0 and at most 1");
+    xbt_assert (config.combiner_cost >= 0.0, "Combiner cost can't be negative");
+    xbt_assert (config.compress_ratio > 0.0 && config.compress_ratio <= 1.0,
+	    "Compression ratio must be greater than 0 and at most 1");
+    xbt_assert (config.compress_ratio == 1.0 || (config.compress_speed > 0.0 && config.decompress_speed > 0.0),
+	    "Compression and decompression speeds must be greater than zero");
+
+    config.io_sort_buffer = (uint64_t) io_sort_mb * 1024 * 1024;
+
+    find_pool (DEFAULT_POOL);
+    for (p = 0; p < config.pool_count; p++)
+    {
+	pool = &config.pools[p];
+	xbt_assert (pool->min_share >= 0, "Minimum share of pool %s can't be negative", pool->name);
+	xbt_assert (pool->weight > 0.0, "Weight of pool %s must be greater than zero", pool->name);
+	xbt_assert (pool->capacity >= 0.0 && pool->capacity <= pool->max_capacity && pool->max_capacity <= 1.0,
+		"Capacities of queue %s must satisfy 0 <= capacity <= max_capacity <= 100", pool->name);
+	capacity += pool->capacity;
+    }
+    xbt_assert (capacity <= 1.0 + 1e-9, "Queue capacities add up to more than 100%%");
+
+    /* Without queues, the default queue gets the whole cluster. */
+    if (capacity == 0.0)
+	config.pools[find_pool (DEFAULT_POOL)].capacity = 1.0;
+
+    xbt_assert (config.job_history == NULL || config.workload_trace == NULL,
+	    "A job history can't be replayed with a workload trace");
+
+    if (config.job_history != NULL)
+    {
+	read_job_history (config.job_history);
+	sort_jobs ();
+    }
+    else if (config.workload_trace != NULL)
+    {
+	read_workload_trace (config.workload_trace);
+	sort_jobs ();
+    }
+    else
+    {
+	/* A single job, described by the configuration file. */
+	xbt_assert (config.chunk_count > 0, "The amount of input chunks must be greater than zero");
+	workload.job_count = 1;
+	workload.jobs = xbt_new (job_t, 1);
+	workload.jobs[0] = new_job (0.0, config.chunk_count, config.amount_of_tasks[REDUCE]);
+    }
+}
+
+/**
+ * @brief  Read the jobs of the workload trace.
+ * @param  file_name  The path/name of the trace file.
+ *
+ * Each line describes a job:
+ *   submit_time input_chunks reduces [map_cost reduce_cost map_output_MB] [pool]
+ * The optional profile gives the cost of every map and reduce task (flops)
+ * and the output of every map (MB), instead of the user functions.
+ * The optional pool (or queue) name is used by the fair and capacity
+ * schedulers; jobs without one go to the default pool.
+ * Lines starting with '#' are comments.
+ */
+static void read_workload_trace (const char* file_name)
+{
+    char    line[MAX_LINE_SIZE];
+    char    pool_name[POOL_NAME_SIZE];
+    double  map_cost;
+    double  map_output;
+    double  reduce_cost;
+    double  submit_time;
+    FILE*   file;
+    int     chunks;
+    int     fields;
+    int     line_number = 0;
+    int     more;
+    int     reduces;
+    int     used;
+    job_t   job;
+    size_t  capacity = 16;
+
+    file = fopen (file_name, "r");
+
+    xbt_assert (file != NULL, "Error reading workload trace: %s", file_name);
+
+    workload.job_count = 0;
+    workload.jobs = xbt_new (job_t, capacity);
+
+    while ( fgets (line, MAX_LINE_SIZE, file) != NULL )
+    {
+	line_number++;
+
+	if (line[strspn (line, " \t")] == '#')
+	    continue;
+
+	fields = sscanf (line, "%lg %d %d%n", &submit_time, &chunks, &reduces, &used);
+
+	if (fields <= 0)
+	    continue;
+
+	xbt_assert (fields == 3, "Invalid job in %s, line %d", file_name, line_number);
+
+	/* Optional cost profile. */
+	fields = sscanf (line + used, "%lg %lg %lg%n", &map_cost, &reduce_cost, &map_output, &more);
+	xbt_assert (fields <= 0 || fields == 3, "Invalid job profile in %s, line %d", file_name, line_number);
+	if (fields == 3)
+	    used += more;
+	xbt_assert (submit_time >= 0.0, "Submit time can't be negative (%s, line %d)", file_name, line_number);
+	xbt_assert (chunks > 0, "The amount of input chunks must be greater than zero (%s, line %d)", file_name, line_number);
+	xbt_assert (reduces >= 0, "The number of reduce tasks can't be negative (%s, line %d)", file_name, line_number);
+
+	if (workload.job_count == capacity)
+	{
+	    capacity *= 2;
+	    workload.jobs = xbt_realloc (workload.jobs, capacity * sizeof (job_t));
+	}
+
+	job = new_job (submit_time, chunks, reduces);
+
+	if (sscanf (line + used, "%63s", pool_name) == 1)
+	    job->pool = find_pool (pool_name);
+
+	if (fields == 3)
+	{
+	    xbt_assert (map_cost >= 0.0 && reduce_cost >= 0.0 && map_output >= 0.0,
+		    "Job costs can't be negative (%s, line %d)", file_name, line_number);
+	    job->has_profile = 1;
+	    job->profile_cost[MAP] = map_cost;
+	    job->profile_cost[REDUCE] = reduce_cost;
+	    /* The output of a map is split evenly among the reduces. */
+	    if (reduces > 0)
+		job->profile_output = (uint64_t) (map_output * 1024 * 1024 / reduces);
+	}
+
+	workload.jobs[workload.job_count++] = job;
+    }
+
+    fclose (file);
+
+    xbt_assert (workload.job_count > 0, "No jobs in workload trace: %s", file_name);
+}
+
+/**
+ * @brief  Submit, and number, the jobs in order of submit time.
+ */
+static void sort_jobs (void)
+{
+    size_t  jid;
+
+    qsort (workload.jobs, workload.job_count, sizeof (job_t), compare_submit_time);
+    for (jid = 0; jid < workload.job_count; jid++)
+	workload.jobs[jid]->id = jid;
+}
+
+static int compare_submit_time (const void* a, const void* b)
+{
+    job_t  ja = *(const job_t*) a;
+    job_t  jb = *(const job_t*) b;
+
+    if (ja->submit_time < jb->submit_time)
+	return -1;
+    if (ja->submit_time > jb->submit_time)
+	return 1;
+    /* Keep the trace order of simultaneous jobs. */
+    return (ja->id < jb->id ? -1 : 1);
+}
+
+job_t new_job (double submit_time, int chunks, int reduces)
+{
+    job_t  job;
+
+    job = xbt_new0 (struct job_s, 1);
+    job->id = workload.job_count;
+    job->submit_time = submit_time;
+    job->start_time = -1.0;
+    job->chunk_count = chunks;
+    job->amount_of_tasks[MAP] = chunks;
+    job->amount_of_tasks[REDUCE] = reduces;
+    job->pool = find_pool (DEFAULT_POOL);
+
+    return job;
+}
+
+size_t find_pool (const char* name)
+{
+    size_t          p;
+    struct pool_s*  pool;
+
+    for (p = 0; p < config.pool_count; p++)
+    {
+	if ( strcmp (config.pools[p].name, name) == 0 )
+	    return p;
+    }
+
+    config.pools = xbt_realloc (config.pools, (config.pool_count + 1) * sizeof (struct pool_s));
+    pool = &config.pools[config.pool_count];
+    strncpy (pool->name, name, POOL_NAME_SIZE - 1);
+    pool->name[POOL_NAME_SIZE - 1] = '\0';
+    pool->min_share = 0;
+    pool->weight = 1.0;
+    pool->capacity = 0.0;
+    pool->max_capacity = 1.0;
+    pool->running[MAP] = pool->running[REDUCE] = 0;
+    pool->starved_since[MAP] = pool->starved_since[REDUCE] = -1.0;
+
+    return config.pool_count++;
 }
 
 /**
  * @brief  Initialize the config structure.
+ * @param  cache  The workers of the deployment, or NULL to find them.
  */
-static void init_config (void)
+static void init_config (struct platform_cache_s* cache)
 {
+    int            beat;
     const char*    process_name = NULL;
     msg_host_t     host;
     msg_process_t  process;
@@ -205,79 +818,359 @@ static void init_config (void)
 
     /* Initialize hosts information. */
 
-    config.number_of_workers = 0;
+    config.grid_cpu_power = 0.0;
 
-    process_list = MSG_processes_as_dynar ();
-    xbt_dynar_foreach (process_list, cursor, process)
+    if (cache != NULL)
     {
-	process_name = MSG_process_get_name (process);
-	if ( strcmp (process_name, "worker") == 0 )
-	    config.number_of_workers++;
+	config.master = cache->master;
+	config.number_of_workers = cache->worker_count;
+	config.workers = xbt_new (msg_host_t, config.number_of_workers);
+	for (wid = 0; wid < config.number_of_workers; wid++)
+	{
+	    config.workers[wid] = cache->workers[wid];
+	    config.grid_cpu_power += cache->speeds[wid];
+	}
     }
+    else
+    {
+	config.number_of_workers = 0;
 
-    config.workers = xbt_new (msg_host_t, config.number_of_workers);
+	process_list = MSG_processes_as_dynar ();
+	xbt_dynar_foreach (process_list, cursor, process)
+	{
+	    process_name = MSG_process_get_name (process);
+	    if ( strcmp (process_name, "worker") == 0 )
+		config.number_of_workers++;
+	}
 
-    wid = 0;
-    config.grid_cpu_power = 0.0;
-    xbt_dynar_foreach (process_list, cursor, process)
-    {
-	process_name = MSG_process_get_name (process);
-	host = MSG_process_get_host (process);
-	if ( strcmp (process_name, "worker") == 0 )
-	{
-	    config.workers[wid] = host;
-	    /* Set the worker ID as its data. */
-	    wi = xbt_new (struct w_info_s, 1);
-	    wi->wid = wid;
-	    MSG_host_set_data (host, (void*)wi);
-	    /* Add the worker's cpu power to the grid total. */
-	    config.grid_cpu_power += MSG_get_host_speed (host);
-	    wid++;
+	config.workers = xbt_new (msg_host_t, config.number_of_workers);
+
+	wid = 0;
+	xbt_dynar_foreach (process_list, cursor, process)
+	{
+	    process_name = MSG_process_get_name (process);
+	    host = MSG_process_get_host (process);
+	    if ( strcmp (process_name, "worker") == 0 )
+	    {
+		config.workers[wid] = host;
+		/* Add the worker's cpu power to the grid total. */
+		config.grid_cpu_power += MSG_get_host_speed (host);
+		wid++;
+	    }
+	    else if ( strcmp (process_name, "master") == 0 )
+	    {
+		config.master = host;
+	    }
 	}
     }
+
+    /* Set the worker ID as its data. */
+    for (wid = 0; wid < config.number_of_workers; wid++)
+    {
+	wi = xbt_new0 (struct w_info_s, 1);
+	wi->wid = wid;
+	sprintf (wi->tasktracker, TASKTRACKER_MAILBOX, wid);
+	sprintf (wi->datanode, DATANODE_MAILBOX, wid);
+	sprintf (wi->disk, DISK_MAILBOX, wid);
+	MSG_host_set_data (config.workers[wid], (void*)wi);
+    }
+
     config.grid_average_speed = config.grid_cpu_power / config.number_of_workers;
     config.heartbeat_interval = maxval (HEARTBEAT_MIN_INTERVAL, config.number_of_workers / 100);
+    beat = (config.heartbeat_mode == HB_PUSH ? config.keepalive_interval : config.heartbeat_interval);
+    if (config.heartbeat_timeout == 0.0)
+    {
+	/* The interval grows with the platform, and so does the default. */
+	config.heartbeat_timeout = maxval (HEARTBEAT_TIMEOUT, HEARTBEAT_TIMEOUT_BEATS * beat);
+    }
+    else
+    {
+	xbt_assert (config.heartbeat_timeout > beat,
+		"Heartbeat timeout must be greater than the %s interval (%d s)",
+		(config.heartbeat_mode == HB_PUSH ? "keepalive" : "heartbeat"), beat);
+    }
     config.amount_of_tasks[MAP] = config.chunk_count;
+    init_racks (cache);
+    init_resources ();
     config.initialized = 1;
 }
 
 /**
- * @brief  Initialize the job structure.
+ * @brief  Find the resources of every worker, and what a task takes.
+ *
+ * The slots (map_slots, reduce_slots) or the container resources
+ * (memory_mb, vcores) of a worker can be given as properties of its host
+ * in the platform file.
  */
-static void init_job (void)
+static void init_resources (void)
 {
-    int     i;
-    size_t  wid;
+    enum phase_e         phase;
+    msg_host_t           host;
+    size_t               wid;
+    struct resources_s*  capacity;
 
-    xbt_assert (config.initialized, "init_config has to be called before init_job");
+    if (config.resource_model == RM_SLOTS)
+    {
+	for (phase = MAP; phase <= REDUCE; phase++)
+	{
+	    config.demand[phase].amount[MAP] = (phase == MAP);
+	    config.demand[phase].amount[REDUCE] = (phase == REDUCE);
+	}
+    }
+    else
+    {
+	config.demand[MAP] = config.container[MAP];
+	config.demand[REDUCE] = config.container[REDUCE];
+    }
+
+    config.capacity = xbt_new (struct resources_s, config.number_of_workers);
+    config.total_slots[MAP] = 0;
+    config.total_slots[REDUCE] = 0;
+
+    for (wid = 0; wid < config.number_of_workers; wid++)
+    {
+	host = config.workers[wid];
+	capacity = &config.capacity[wid];
+	if (config.resource_model == RM_SLOTS)
+	{
+	    capacity->amount[MAP] = host_resource (host, "map_slots", config.slots[MAP]);
+	    capacity->amount[REDUCE] = host_resource (host, "reduce_slots", config.slots[REDUCE]);
+	}
+	else
+	{
+	    capacity->amount[RES_MEMORY] = host_resource (host, "memory_mb", config.node_resources.amount[RES_MEMORY]);
+	    capacity->amount[RES_VCORES] = host_resource (host, "vcores", config.node_resources.amount[RES_VCORES]);
+	}
+	config.total_slots[MAP] += max_tasks (wid, MAP);
+	config.total_slots[REDUCE] += max_tasks (wid, REDUCE);
+    }
+
+    xbt_assert (config.total_slots[MAP] > 0, "No worker has room for a map task");
+    xbt_assert (config.total_slots[REDUCE] > 0, "No worker has room for a reduce task");
+}
+
+/**
+ * @brief  Get a resource of a host.
+ * @param  host      The host.
+ * @param  property  The host property that overrides the default.
+ * @param  amount    The default amount.
+ * @return The amount.
+ */
+static int host_resource (msg_host_t host, const char* property, int amount)
+{
+    const char*  value;
+
+    value = MSG_host_get_property_value (host, property);
+    if (value != NULL)
+	amount = atoi (value);
 
-    job.finished = 0;
-    job.heartbeats = xbt_new (struct heartbeat_s, config.number_of_workers);
+    xbt_assert (amount >= 0, "Invalid %s of host %s", property, MSG_host_get_name (host));
+
+    return amount;
+}
+
+/**
+ * @brief  Find the rack of every worker.
+ *
+ * The workers of each routing zone (AS, such as a <cluster>) of the
+ * platform form a rack.
+ *
+ * @param  cache  The workers of the deployment, or NULL to walk the zones.
+ */
+static void init_racks (struct platform_cache_s* cache)
+{
+    size_t   rack;
+    size_t   wid;
+    size_t*  next;
+
+    config.rack_count = 0;
+    config.worker_rack = xbt_new (size_t, config.number_of_workers);
+
+    if (cache != NULL)
+    {
+	config.rack_count = cache->rack_count;
+	memcpy (config.worker_rack, cache->worker_rack, config.number_of_workers * sizeof (size_t));
+    }
+    else
+    {
+	for (wid = 0; wid < config.number_of_workers; wid++)
+	    config.worker_rack[wid] = NONE;
+
+	find_racks (MSG_environment_get_routing_root ());
+    }
+
+    for (wid = 0; wid < config.number_of_workers; wid++)
+	xbt_assert (config.worker_rack[wid] != NONE, "Worker %s is not in the platform routing", MSG_host_get_name (config.workers[wid]));
+
+    /* Build the worker lists of the racks. */
+    config.rack_start = xbt_new0 (size_t, config.rack_count + 1);
     for (wid = 0; wid < config.number_of_workers; wid++)
+	config.rack_start[config.worker_rack[wid] + 1]++;
+    for (rack = 0; rack < config.rack_count; rack++)
+	config.rack_start[rack + 1] += config.rack_start[rack];
+
+    next = xbt_new (size_t, config.rack_count);
+    for (rack = 0; rack < config.rack_count; rack++)
+	next[rack] = config.rack_start[rack];
+
+    config.rack_worker = xbt_new (size_t, config.number_of_workers);
+    for (wid = 0; wid < config.number_of_workers; wid++)
+	config.rack_worker[next[config.worker_rack[wid]]++] = wid;
+
+    xbt_free_ref (&next);
+}
+
+/**
+ * @brief  Make racks of the workers of a routing zone and of its subzones.
+ * @param  as  The routing zone.
+ *
+ * Subzones come first, so a zone only gets the workers that are not in
+ * any of its subzones.
+ */
+static void find_racks (msg_as_t as)
+{
+    char*               key;
+    int                 found = 0;
+    msg_as_t            son;
+    msg_host_t          host;
+    unsigned int        cursor;
+    w_info_t            wi;
+    xbt_dict_cursor_t   dict_cursor = NULL;
+    xbt_dynar_t         hosts;
+
+    xbt_dict_foreach (MSG_environment_as_get_routing_sons (as), dict_cursor, key, son)
     {
-	job.heartbeats[wid].slots_av[MAP] = config.slots[MAP];
-	job.heartbeats[wid].slots_av[REDUCE] = config.slots[REDUCE];
+	find_racks (son);
+    }
+
+    hosts = MSG_environment_as_get_hosts (as);
+    xbt_dynar_foreach (hosts, cursor, host)
+    {
+	wi = (w_info_t) MSG_host_get_data (host);
+	if (wi != NULL && config.workers[wi->wid] == host && config.worker_rack[wi->wid] == NONE)
+	{
+	    config.worker_rack[wi->wid] = config.rack_count;
+	    found = 1;
+	}
     }
+    xbt_dynar_free (&hosts);
+
+    if (found)
+	config.rack_count++;
+}
+
+/**
+ * @brief  Initialize the workload structure.
+ */
+static void init_workload (void)
+{
+    size_t    jid;
+    size_t    wid;
+    w_info_t  wi;
+
+    xbt_assert (config.initialized, "init_config has to be called before init_workload");
+
+    workload.finished = 0;
+    workload.jobs_done = 0;
+    workload.active = xbt_new (job_t, workload.job_count);
+    workload.active_count = 0;
+    workload.copy_bytes = 0.0;
+    workload.copy_time = 0.0;
+    workload.start_clock = MSG_get_clock ();
+
+    memset (&perf, 0, sizeof (perf));
+
+    init_obj_pool (&obj_pools.messages, "messages", sizeof (struct message_s));
+    init_obj_pool (&obj_pools.task_infos, "task_infos", sizeof (struct task_info_s));
+    init_obj_pool (&obj_pools.shuffles, "shuffles", shuffle_size ());
+
+    workload.heartbeats = xbt_new (struct resources_s, config.number_of_workers);
+    workload.last_seen = xbt_new0 (double, config.number_of_workers);
+    workload.lost = xbt_new0 (char, config.number_of_workers);
+    workload.failures = xbt_new0 (int, config.number_of_workers);
+    workload.next_expiry = 0.0;
+    for (wid = 0; wid < config.number_of_workers; wid++)
+    {
+	workload.heartbeats[wid] = config.capacity[wid];
+	wi = (w_info_t) MSG_host_get_data (config.workers[wid]);
+	memset (&wi->freed, 0, sizeof (struct resources_s));
+	wi->failed = 0;
+	wi->restarted = 0;
+    }
+
+    /* Jobs with a cost profile or a history don't use the user functions. */
+    for (jid = 0; jid < workload.job_count; jid++)
+    {
+	if (!workload.jobs[jid]->has_profile && workload.jobs[jid]->history == NULL)
+	{
+	    xbt_assert (user.task_cost_f != NULL, "Task cost function not specified.");
+	    xbt_assert (user.map_output_f != NULL, "Map output function not specified.");
+	}
+    }
+
+    check_cost_table ();
+}
+
+void init_job (job_t job)
+{
+    int     i;
+    size_t  wid;
+
+    xbt_assert (config.initialized, "init_config has to be called before init_job");
+
+    job->finished = 0;
 
     /* Initialize map information. */
-    job.tasks_pending[MAP] = config.amount_of_tasks[MAP];
-    job.task_status[MAP] = xbt_new0 (int, config.amount_of_tasks[MAP]);
-    job.task_instances[MAP] = xbt_new0 (int, config.amount_of_tasks[MAP]);
-    job.task_list[MAP] = xbt_new0 (msg_task_t*, config.amount_of_tasks[MAP]);
-    for (i = 0; i < config.amount_of_tasks[MAP]; i++)
-	job.task_list[MAP][i] = xbt_new0 (msg_task_t, MAX_SPECULATIVE_COPIES);
+    job->tasks_pending[MAP] = job->amount_of_tasks[MAP];
+    job->task_status[MAP] = xbt_new0 (int, job->amount_of_tasks[MAP]);
+    job->task_instances[MAP] = xbt_new0 (int, job->amount_of_tasks[MAP]);
+    job->task_list[MAP] = xbt_new0 (msg_task_t*, job->amount_of_tasks[MAP]);
+    for (i = 0; i < job->amount_of_tasks[MAP]; i++)
+	job->task_list[MAP][i] = xbt_new0 (msg_task_t, MAX_SPECULATIVE_COPIES);
 
-    job.map_output = xbt_new (size_t*, config.number_of_workers);
-    for (i = 0; i < config.number_of_workers; i++)
-	job.map_output[i] = xbt_new0 (size_t, config.amount_of_tasks[REDUCE]);
+    init_map_output (job);
+    job->map_output = xbt_new (uint64_t*, config.number_of_workers);
+    for (wid = 0; wid < config.number_of_workers; wid++)
+	job->map_output[wid] = xbt_new0 (uint64_t, job->amount_of_tasks[REDUCE]);
+    job->map_worker = xbt_new (size_t, job->amount_of_tasks[MAP]);
 
     /* Initialize reduce information. */
-    job.tasks_pending[REDUCE] = config.amount_of_tasks[REDUCE];
-    job.task_status[REDUCE] = xbt_new0 (int, config.amount_of_tasks[REDUCE]);
-    job.task_instances[REDUCE] = xbt_new0 (int, config.amount_of_tasks[REDUCE]);
-    job.task_list[REDUCE] = xbt_new0 (msg_task_t*, config.amount_of_tasks[REDUCE]);
-    for (i = 0; i < config.amount_of_tasks[REDUCE]; i++)
-	job.task_list[REDUCE][i] = xbt_new0 (msg_task_t, MAX_SPECULATIVE_COPIES);
+    job->tasks_pending[REDUCE] = job->amount_of_tasks[REDUCE];
+    job->task_status[REDUCE] = xbt_new0 (int, job->amount_of_tasks[REDUCE]);
+    job->task_instances[REDUCE] = xbt_new0 (int, job->amount_of_tasks[REDUCE]);
+    job->task_list[REDUCE] = xbt_new0 (msg_task_t*, job->amount_of_tasks[REDUCE]);
+    for (i = 0; i < job->amount_of_tasks[REDUCE]; i++)
+	job->task_list[REDUCE][i] = xbt_new0 (msg_task_t, MAX_SPECULATIVE_COPIES);
+
+    distribute_data (job);
+    init_locality_index (job);
+    init_shuffles (job);
+}
+
+void free_job (job_t job)
+{
+    int     i;
+    size_t  wid;
+
+    free_locality_index (job);
+    free_shuffles (job);
+    free_data (job);
+    free_map_output (job);
+
+    for (wid = 0; wid < config.number_of_workers; wid++)
+	xbt_free_ref (&job->map_output[wid]);
+    xbt_free_ref (&job->map_output);
+    xbt_free_ref (&job->map_worker);
+    xbt_free_ref (&job->task_status[MAP]);
+    xbt_free_ref (&job->task_instances[MAP]);
+    xbt_free_ref (&job->task_status[REDUCE]);
+    xbt_free_ref (&job->task_instances[REDUCE]);
+    for (i = 0; i < job->amount_of_tasks[MAP]; i++)
+	xbt_free_ref (&job->task_list[MAP][i]);
+    xbt_free_ref (&job->task_list[MAP]);
+    for (i = 0; i < job->amount_of_tasks[REDUCE]; i++)
+	xbt_free_ref (&job->task_list[REDUCE][i]);
+    xbt_free_ref (&job->task_list[REDUCE]);
 }
 
 /**
@@ -288,11 +1181,14 @@ static void init_stats (void)
     xbt_assert (config.initialized, "init_config has to be called before init_stats");
 
     stats.map_local = 0;
+    stats.map_rack = 0;
     stats.map_remote = 0;
     stats.map_spec_l = 0;
+    stats.map_spec_rk = 0;
     stats.map_spec_r = 0;
     stats.reduce_normal = 0;
     stats.reduce_spec = 0;
+    stats.map_skips = 0;
 }
 
 /**
@@ -300,24 +1196,69 @@ static void init_stats (void)
  */
 static void free_global_mem (void)
 {
-    size_t  i;
+    enum trace_level_e level;
+    size_t       jid;
+    size_t       wid;
+    task_info_t* tasks;
+    task_info_t  ti;
+
+    /* The copies cancelled when the last job ended never report back, and
+     * no process is left to hold them. */
+    for (wid = 0; wid < config.number_of_workers; wid++)
+    {
+	while (running_tasks (wid, &tasks) > 0)
+	{
+	    ti = tasks[0];
+	    task_finished (ti, 0);
+	    ti->refs = 1;
+	    release_task_info (ti);
+	}
+    }
+
+    for (jid = 0; jid < workload.job_count; jid++)
+    {
+	/* Only submitted jobs were initialized. */
+	if (workload.jobs[jid]->task_status[MAP] != NULL)
+	    free_job (workload.jobs[jid]);
+	free_history (workload.jobs[jid]);
+	xbt_free_ref (&workload.jobs[jid]);
+    }
+    xbt_free_ref (&workload.jobs);
+    xbt_free_ref (&workload.active);
+    xbt_free_ref (&workload.heartbeats);
+    xbt_free_ref (&workload.last_seen);
+    xbt_free_ref (&workload.lost);
+    xbt_free_ref (&workload.failures);
+    free_speculation ();
+    free_scheduler ();
+    free_obj_pool (&obj_pools.messages);
+    free_obj_pool (&obj_pools.task_infos);
+    free_obj_pool (&obj_pools.shuffles);
 
-    for (i = 0; i < config.chunk_count; i++)
-	xbt_free_ref (&chunk_owner[i]);
-    xbt_free_ref (&chunk_owner);
+    for (wid = 0; wid < config.number_of_workers; wid++)
+    {
+	xbt_free (MSG_host_get_data (config.workers[wid]));
+	MSG_host_set_data (config.workers[wid], NULL);
+    }
 
     xbt_free_ref (&config.workers);
-    xbt_free_ref (&job.task_status[MAP]);
-    xbt_free_ref (&job.task_instances[MAP]);
-    xbt_free_ref (&job.task_status[REDUCE]);
-    xbt_free_ref (&job.task_instances[REDUCE]);
-    xbt_free_ref (&job.heartbeats);
-    for (i = 0; i < config.amount_of_tasks[MAP]; i++)
-	xbt_free_ref (&job.task_list[MAP][i]);
-    xbt_free_ref (&job.task_list[MAP]);
-    for (i = 0; i < config.amount_of_tasks[REDUCE]; i++)
-	xbt_free_ref (&job.task_list[REDUCE][i]);
-    xbt_free_ref (&job.task_list[REDUCE]);
+    xbt_free_ref (&config.capacity);
+    xbt_free_ref (&config.worker_rack);
+    xbt_free_ref (&config.rack_start);
+    xbt_free_ref (&config.rack_worker);
+    xbt_free_ref (&config.workload_trace);
+    xbt_free_ref (&config.job_history);
+    xbt_free_ref (&config.task_trace);
+    xbt_free_ref (&config.results_file);
+    xbt_free_ref (&config.failure_trace);
+    xbt_free_ref (&config.pools);
+
+    /* Leave nothing for the next run, but the trace level. */
+    level = config.trace_level;
+    memset (&config, 0, sizeof (config));
+    config.trace_level = level;
+    memset (&workload, 0, sizeof (workload));
+    memset (&stats, 0, sizeof (stats));
 }
 
 // vim: set ts=8 sw=4:
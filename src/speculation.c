@@ -0,0 +1,274 @@
+/* Copyright (c) 2012. MRSG Team. All rights reserved. */
+
+/* This file is part of MRSG.
+
+MRSG is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+MRSG is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <float.h>
+#include <stdlib.h>
+#include "common.h"
+#include "worker.h"
+#include "scheduling.h"
+#include "speculation.h"
+
+static double task_progress (task_info_t ti);
+static int is_slow_node (size_t wid);
+static int compare_rates (const void* a, const void* b);
+
+/* Running task copies of each worker (ti->running_pos is the index). */
+static task_info_t**  running;
+static size_t*        running_count;
+static int            spec_running;
+
+/* Map completion rates of each worker, to find the slow nodes. */
+static double*        node_rate_sum;
+static int*           node_rate_count;
+static double*        node_rates;
+static double         slow_node_rate;
+static double         slow_node_time;
+
+
+void init_speculation (void)
+{
+    size_t  wid;
+
+    running = xbt_new (task_info_t*, config.number_of_workers);
+    running_count = xbt_new0 (size_t, config.number_of_workers);
+    for (wid = 0; wid < config.number_of_workers; wid++)
+	running[wid] = xbt_new (task_info_t, max_tasks (wid, MAP) + max_tasks (wid, REDUCE));
+
+    node_rate_sum = xbt_new0 (double, config.number_of_workers);
+    node_rate_count = xbt_new0 (int, config.number_of_workers);
+    node_rates = xbt_new (double, config.number_of_workers);
+
+    spec_running = 0;
+    slow_node_rate = 0.0;
+    slow_node_time = -1.0;
+}
+
+void free_speculation (void)
+{
+    size_t  wid;
+
+    for (wid = 0; wid < config.number_of_workers; wid++)
+	xbt_free_ref (&running[wid]);
+    xbt_free_ref (&running);
+    xbt_free_ref (&running_count);
+    xbt_free_ref (&node_rate_sum);
+    xbt_free_ref (&node_rate_count);
+    xbt_free_ref (&node_rates);
+}
+
+void task_started (task_info_t ti)
+{
+    job_t  job = ti->job;
+
+    ti->speculative = (job->task_status[ti->phase][ti->id] == T_STATUS_TIP_SLOW);
+    ti->rate = 0.0;
+    ti->rated = 0;
+    ti->time_left = DBL_MAX;
+
+    ti->running_pos = running_count[ti->wid];
+    running[ti->wid][running_count[ti->wid]++] = ti;
+
+    if (ti->speculative)
+	spec_running++;
+}
+
+void task_stopped (task_info_t ti)
+{
+    job_t  job = ti->job;
+
+    if (!ti->rated)
+	return;
+
+    job->rate_sum[ti->phase] -= ti->rate;
+    job->rate_count[ti->phase]--;
+    ti->rated = 0;
+}
+
+void task_finished (task_info_t ti, int completed)
+{
+    task_info_t  last;
+
+    last = running[ti->wid][--running_count[ti->wid]];
+    running[ti->wid][ti->running_pos] = last;
+    last->running_pos = ti->running_pos;
+
+    task_stopped (ti);
+
+    if (ti->speculative)
+	spec_running--;
+
+    if (completed && ti->phase == MAP && sim_clock () > ti->start_time)
+    {
+	node_rate_sum[ti->wid] += 1.0 / (sim_clock () - ti->start_time);
+	node_rate_count[ti->wid]++;
+    }
+}
+
+size_t running_tasks (size_t wid, task_info_t** tasks)
+{
+    *tasks = running[wid];
+    return running_count[wid];
+}
+
+void update_task_progress (size_t wid)
+{
+    double       elapsed;
+    double       progress;
+    double       rate;
+    job_t        job;
+    size_t       i;
+    task_info_t  ti;
+
+    for (i = 0; i < running_count[wid]; i++)
+    {
+	ti = running[wid][i];
+	job = ti->job;
+	elapsed = sim_clock () - ti->start_time;
+
+	if (ti->killed || elapsed <= 0.0
+		|| job->task_status[ti->phase][ti->id] == T_STATUS_DONE)
+	    continue;
+
+	/* A copy counts in the mean from its first sample on. */
+	if (!ti->rated)
+	{
+	    ti->rated = 1;
+	    ti->rate = 0.0;
+	    job->rate_count[ti->phase]++;
+	}
+
+	progress = task_progress (ti);
+	rate = progress / elapsed;
+	job->rate_sum[ti->phase] += rate - ti->rate;
+	ti->rate = rate;
+	ti->time_left = (rate > 0.0 ? (1.0 - progress) / rate : DBL_MAX);
+
+	if (elapsed >= SPECULATIVE_LAG
+		&& job->task_status[ti->phase][ti->id] == T_STATUS_TIP
+		&& job->task_instances[ti->phase][ti->id] < 2
+		&& rate < config.slow_task_threshold * job->rate_sum[ti->phase] / job->rate_count[ti->phase])
+	{
+	    job->task_status[ti->phase][ti->id] = T_STATUS_TIP_SLOW;
+	    if (ti->phase == MAP)
+		update_locality_index (job, ti->id);
+	}
+    }
+}
+
+int may_speculate (size_t wid)
+{
+    if (spec_running >= config.speculative_cap * (config.total_slots[MAP] + config.total_slots[REDUCE]))
+	return 0;
+
+    return !is_slow_node (wid);
+}
+
+double task_time_left (job_t job, enum phase_e phase, size_t tid)
+{
+    int          i;
+    task_info_t  ti;
+
+    for (i = 0; i < MAX_SPECULATIVE_COPIES; i++)
+    {
+	if (job->task_list[phase][tid][i] != NULL)
+	{
+	    ti = (task_info_t) MSG_task_get_data (job->task_list[phase][tid][i]);
+	    return ti->time_left;
+	}
+    }
+
+    return 0.0;
+}
+
+/**
+ * @brief  Progress score of a task copy, between 0 and 1.
+ * @param  ti  The task information of the copy.
+ *
+ * Maps progress with their computation. Reduces progress half with the
+ * copy of their input and half with their computation.
+ */
+static double task_progress (task_info_t ti)
+{
+    double     computed = 0.0;
+    double     copied = 0.0;
+    double     duration;
+    shuffle_t  sh;
+
+    duration = MSG_task_get_compute_duration (ti->task);
+    if (duration > 0.0)
+	computed = 1.0 - MSG_task_get_remaining_computation (ti->task) / duration;
+
+    if (ti->phase == MAP)
+	return computed;
+
+    if (ti->shuffle_end > 0.0 || reduce_input_size (ti->job, ti->id) == 0)
+    {
+	copied = 1.0;
+    }
+    else
+    {
+	for (sh = ti->job->shuffles[ti->id]; sh != NULL; sh = sh->next)
+	{
+	    if (sh->ti == ti)
+	    {
+		copied = (double) sh->total_copied / sh->must_copy;
+		break;
+	    }
+	}
+    }
+
+    return (copied + computed) / 2;
+}
+
+/**
+ * @brief  Check if the map completion rate of a worker is below the
+ *         config.slow_node_threshold percentile of all the workers.
+ * @param  wid  Worker id.
+ *
+ * The percentile is computed at most once per heartbeat interval.
+ */
+static int is_slow_node (size_t wid)
+{
+    size_t  n = 0;
+    size_t  w;
+
+    if (node_rate_count[wid] == 0)
+	return 0;
+
+    if (slow_node_time < 0.0 || sim_clock () - slow_node_time >= config.heartbeat_interval)
+    {
+	for (w = 0; w < config.number_of_workers; w++)
+	    if (node_rate_count[w] > 0)
+		node_rates[n++] = node_rate_sum[w] / node_rate_count[w];
+
+	qsort (node_rates, n, sizeof (double), compare_rates);
+	slow_node_rate = node_rates[(size_t) (config.slow_node_threshold * (n - 1))];
+	slow_node_time = sim_clock ();
+    }
+
+    return (node_rate_sum[wid] / node_rate_count[wid] < slow_node_rate);
+}
+
+static int compare_rates (const void* a, const void* b)
+{
+    double  ra = *(const double*) a;
+    double  rb = *(const double*) b;
+
+    return (ra < rb ? -1 : (ra > rb ? 1 : 0));
+}
+
+// vim: set ts=8 sw=4:
@@ -0,0 +1,337 @@
+/* Copyright (c) 2012. MRSG Team. All rights reserved. */
+
+/* This file is part of MRSG.
+
+MRSG is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+MRSG is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "common.h"
+#include "mrsg.h"
+
+#define SWEEP_LINE_SIZE 4096
+
+/** @brief  A swept configuration property. */
+struct sweep_param_s {
+    char*   name;
+    char**  values;
+    size_t  value_count;
+};
+
+static size_t read_sweep_file (const char* file_name, struct sweep_param_s** params);
+static char* read_file (const char* file_name);
+static const char* point_value (struct sweep_param_s* params, size_t param_count, size_t point, size_t p);
+static void write_point_config (const char* csv, size_t point, const char* base,
+	struct sweep_param_s* params, size_t param_count);
+static int run_point (const char* plat, const char* depl, const char* csv, size_t point);
+static void write_table (const char* csv, struct sweep_param_s* params, size_t param_count,
+	size_t point_count, int* status);
+
+int MRSG_sweep (const char* plat, const char* depl, const char* conf, const char* sweep, const char* csv, int procs)
+{
+    char*                  base;
+    int*                   status;
+    int                    failed = 0;
+    int                    running = 0;
+    int                    wstatus;
+    pid_t                  pid;
+    pid_t*                 pids;
+    size_t                 next = 0;
+    size_t                 p;
+    size_t                 param_count;
+    size_t                 point;
+    size_t                 point_count = 1;
+    struct sweep_param_s*  params;
+
+    base = read_file (conf);
+    param_count = read_sweep_file (sweep, &params);
+    for (p = 0; p < param_count; p++)
+	point_count *= params[p].value_count;
+
+    if (procs <= 0)
+	procs = sysconf (_SC_NPROCESSORS_ONLN);
+    if (procs <= 0)
+	procs = 1;
+
+    printf ("sweep: %zu points, %d processes\n", point_count, procs);
+    fflush (stdout);
+
+    status = xbt_new (int, point_count);
+    pids = xbt_new (pid_t, point_count);
+    /* A point that is never reaped keeps a failure status. */
+    for (point = 0; point < point_count; point++)
+	status[point] = -1;
+
+    /* Keep up to procs simulations running, one process per point. */
+    while (next < point_count || running > 0)
+    {
+	if (next < point_count && running < procs)
+	{
+	    write_point_config (csv, next, base, params, param_count);
+	    fflush (NULL);
+	    pid = fork ();
+	    xbt_assert (pid >= 0, "Error creating the process of sweep point %zu", next);
+	    if (pid == 0)
+		_exit (run_point (plat, depl, csv, next));
+
+	    pids[next++] = pid;
+	    running++;
+	    continue;
+	}
+
+	pid = wait (&wstatus);
+	if (pid < 0 && errno == EINTR)
+	    continue;
+	if (pid < 0)
+	{
+	    failed = 1;
+	    break;
+	}
+
+	for (point = 0; point < next && pids[point] != pid; point++);
+	if (point == next)
+	    continue;
+
+	running--;
+	if (WIFEXITED (wstatus))
+	    status[point] = WEXITSTATUS (wstatus);
+	else
+	    status[point] = 128 + WTERMSIG (wstatus);
+	if (status[point] != 0)
+	    failed = 1;
+
+	printf ("sweep: point %zu done (status %d)\n", point, status[point]);
+	fflush (stdout);
+    }
+
+    write_table (csv, params, param_count, point_count, status);
+
+    for (p = 0; p < param_count; p++)
+    {
+	for (point = 0; point < params[p].value_count; point++)
+	    xbt_free (params[p].values[point]);
+	xbt_free (params[p].values);
+	xbt_free (params[p].name);
+    }
+    xbt_free (params);
+    xbt_free (pids);
+    xbt_free (status);
+    xbt_free (base);
+
+    return failed;
+}
+
+/**
+ * @brief  Read the swept properties.
+ * @param  file_name  The sweep file, with lines like "map_slots 1 2 4".
+ * @param  params     Where to store the properties.
+ * @return The number of properties.
+ */
+static size_t read_sweep_file (const char* file_name, struct sweep_param_s** params)
+{
+    char                   line[SWEEP_LINE_SIZE];
+    char*                  token;
+    FILE*                  file;
+    size_t                 count = 0;
+    struct sweep_param_s*  param;
+
+    file = fopen (file_name, "r");
+    xbt_assert (file != NULL, "Error reading sweep file: %s", file_name);
+
+    *params = NULL;
+    while (fgets (line, SWEEP_LINE_SIZE, file) != NULL)
+    {
+	token = strtok (line, " \t\r\n");
+	if (token == NULL || token[0] == '#')
+	    continue;
+
+	*params = xbt_realloc (*params, (count + 1) * sizeof (struct sweep_param_s));
+	param = &(*params)[count++];
+	param->name = xbt_strdup (token);
+	param->values = NULL;
+	param->value_count = 0;
+
+	while ((token = strtok (NULL, " \t\r\n")) != NULL)
+	{
+	    param->values = xbt_realloc (param->values, (param->value_count + 1) * sizeof (char*));
+	    param->values[param->value_count++] = xbt_strdup (token);
+	}
+
+	xbt_assert (param->value_count > 0, "Property %s has no values (in %s)", param->name, file_name);
+    }
+
+    fclose (file);
+
+    return count;
+}
+
+/**
+ * @brief  Read a whole file.
+ * @param  file_name  The file.
+ * @return The file contents, to be freed by the caller.
+ */
+static char* read_file (const char* file_name)
+{
+    char*   data;
+    FILE*   file;
+    long    size;
+
+    file = fopen (file_name, "r");
+    xbt_assert (file != NULL, "Error reading cofiguration file: %s", file_name);
+
+    fseek (file, 0, SEEK_END);
+    size = ftell (file);
+    rewind (file);
+
+    data = xbt_new (char, size + 1);
+    size = fread (data, 1, size, file);
+    data[size] = '\0';
+    fclose (file);
+
+    return data;
+}
+
+/**
+ * @brief  Get the value of a property in a point of the grid.
+ *
+ * The last property varies the fastest.
+ */
+static const char* point_value (struct sweep_param_s* params, size_t param_count, size_t point, size_t p)
+{
+    size_t  q;
+
+    for (q = param_count - 1; q > p; q--)
+	point /= params[q].value_count;
+
+    return params[p].values[point % params[p].value_count];
+}
+
+/**
+ * @brief  Write the configuration file of a point.
+ *
+ * The seed depends only on the point, so each point gets the same results
+ * in every run of the sweep. A seed in the base configuration or in the
+ * grid takes precedence.
+ */
+static void write_point_config (const char* csv, size_t point, const char* base,
+	struct sweep_param_s* params, size_t param_count)
+{
+    char    name[FILENAME_MAX];
+    FILE*   file;
+    size_t  p;
+
+    snprintf (name, FILENAME_MAX, "%s.%zu.conf", csv, point);
+    file = fopen (name, "w");
+    xbt_assert (file != NULL, "Error writing configuration file: %s", name);
+
+    fprintf (file, "seed %zu\n%s\n", DEFAULT_SEED + point, base);
+    for (p = 0; p < param_count; p++)
+	fprintf (file, "%s %s\n", params[p].name, point_value (params, param_count, point, p));
+    fprintf (file, "task_trace none\nresults_file %s.%zu.res\n", csv, point);
+
+    fclose (file);
+}
+
+/**
+ * @brief  Run the simulation of a point, in a child process.
+ * @return The exit status.
+ */
+static int run_point (const char* plat, const char* depl, const char* csv, size_t point)
+{
+    char  name[FILENAME_MAX];
+
+    /* The log of each point goes to its own file. */
+    snprintf (name, FILENAME_MAX, "%s.%zu.log", csv, point);
+    if (freopen (name, "w", stdout) == NULL || dup2 (fileno (stdout), STDERR_FILENO) < 0)
+	return 1;
+
+    MRSG_set_trace_level (MRSG_TRACE_OFF);
+
+    snprintf (name, FILENAME_MAX, "%s.%zu.conf", csv, point);
+    return MRSG_main (plat, depl, name);
+}
+
+/**
+ * @brief  Join the results of the points into a table, and remove the
+ *         temporary files. The logs of the failed points are kept.
+ */
+static void write_table (const char* csv, struct sweep_param_s* params, size_t param_count,
+	size_t point_count, int* status)
+{
+    char    header[SWEEP_LINE_SIZE] = "";
+    char    line[SWEEP_LINE_SIZE];
+    char    name[FILENAME_MAX];
+    FILE*   file;
+    FILE*   table;
+    size_t  p;
+    size_t  point;
+
+    table = fopen (csv, "w");
+    xbt_assert (table != NULL, "Error writing sweep table: %s", csv);
+
+    /* Take the header of the results from the first point that has them. */
+    for (point = 0; point < point_count && header[0] == '\0'; point++)
+    {
+	snprintf (name, FILENAME_MAX, "%s.%zu.res", csv, point);
+	file = fopen (name, "r");
+	if (file == NULL)
+	    continue;
+	if (fgets (header, SWEEP_LINE_SIZE, file) == NULL)
+	    header[0] = '\0';
+	fclose (file);
+    }
+    if (header[0] == '\0')
+	strcpy (header, "\n");
+
+    fprintf (table, "point");
+    for (p = 0; p < param_count; p++)
+	fprintf (table, ",%s", params[p].name);
+    fprintf (table, ",status,%s", header);
+
+    for (point = 0; point < point_count; point++)
+    {
+	fprintf (table, "%zu", point);
+	for (p = 0; p < param_count; p++)
+	    fprintf (table, ",%s", point_value (params, param_count, point, p));
+	fprintf (table, ",%d,", status[point]);
+
+	snprintf (name, FILENAME_MAX, "%s.%zu.res", csv, point);
+	file = fopen (name, "r");
+	if (file != NULL && fgets (line, SWEEP_LINE_SIZE, file) != NULL
+		&& fgets (line, SWEEP_LINE_SIZE, file) != NULL)
+	    fprintf (table, "%s", line);
+	else
+	    fprintf (table, "\n");
+	if (file != NULL)
+	    fclose (file);
+	remove (name);
+
+	snprintf (name, FILENAME_MAX, "%s.%zu.conf", csv, point);
+	remove (name);
+	if (status[point] == 0)
+	{
+	    snprintf (name, FILENAME_MAX, "%s.%zu.log", csv, point);
+	    remove (name);
+	}
+    }
+
+    fclose (table);
+}
+
+// vim: set ts=8 sw=4:
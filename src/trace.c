@@ -0,0 +1,92 @@
+/* Copyright (c) 2012. MRSG Team. All rights reserved. */
+
+/* This file is part of MRSG.
+
+MRSG is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+MRSG is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
+
+
+#include <stdio.h>
+#include <string.h>
+#include "common.h"
+#include "trace.h"
+
+static void flush_events (void);
+
+static FILE*                trace_file;
+static struct task_event_s* events;
+static size_t               event_count;
+
+void trace_open (const char* path)
+{
+    struct trace_header_s  header;
+
+    if (path == NULL)
+	return;
+
+    trace_file = fopen (path, "wb");
+    xbt_assert (trace_file != NULL, "Error opening task trace: %s", path);
+
+    memset (&header, 0, sizeof (header));
+    memcpy (header.magic, TRACE_MAGIC, sizeof (header.magic));
+    header.record_size = sizeof (struct task_event_s);
+    fwrite (&header, sizeof (header), 1, trace_file);
+
+    events = xbt_new (struct task_event_s, TRACE_BUFFER_EVENTS);
+    event_count = 0;
+}
+
+void trace_task_event (size_t jid, enum phase_e phase, size_t tid, int instance,
+	size_t wid, enum task_action_e action, double time, double shuffle_end)
+{
+    struct task_event_s* ev;
+
+    if (trace_file == NULL)
+	return;
+
+    if (event_count == TRACE_BUFFER_EVENTS)
+	flush_events ();
+
+    ev = &events[event_count++];
+    ev->time = time;
+    ev->shuffle_end = shuffle_end;
+    ev->job = jid;
+    ev->tid = tid;
+    ev->wid = wid;
+    ev->instance = instance;
+    ev->phase = phase;
+    ev->action = action;
+}
+
+void trace_close (void)
+{
+    if (trace_file == NULL)
+	return;
+
+    flush_events ();
+    fclose (trace_file);
+    trace_file = NULL;
+    xbt_free_ref (&events);
+}
+
+/**
+ * @brief  Write the buffered events to the trace file.
+ */
+static void flush_events (void)
+{
+    xbt_assert (fwrite (events, sizeof (struct task_event_s), event_count, trace_file) == event_count,
+	    "Error writing the task trace");
+    event_count = 0;
+}
+
+// vim: set ts=8 sw=4:
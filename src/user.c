@@ -26,26 +26,37 @@ void MRSG_init (void)
     user.dfs_f = default_dfs_f;
     user.map_output_f = NULL;
     user.scheduler_f = default_scheduler_f;
+    config.trace_level = MRSG_TRACE_TASKS;
 }
 
-void MRSG_set_task_cost_f ( double (*f)(enum phase_e phase, size_t tid, size_t wid) )
+void MRSG_set_task_cost_f ( double (*f)(size_t jid, enum phase_e phase, size_t tid, size_t wid) )
 {
     user.task_cost_f = f;
 }
 
-void MRSG_set_dfs_f ( void (*f)(char** dfs_matrix, size_t chunks, size_t workers, int replicas) )
+void MRSG_set_dfs_f ( void (*f)(size_t chunks, size_t workers, int replicas) )
 {
     user.dfs_f = f;
 }
 
-void MRSG_set_map_output_f ( int (*f)(size_t mid, size_t rid) )
+void MRSG_set_map_output_f ( uint64_t (*f)(size_t jid, size_t mid, size_t rid) )
 {
     user.map_output_f = f;
 }
 
-void MRSG_set_scheduler_f ( size_t (*f)(enum phase_e phase, size_t wid) )
+void MRSG_set_scheduler_f ( size_t (*f)(size_t jid, enum phase_e phase, size_t wid) )
 {
     user.scheduler_f = f;
 }
 
+void MRSG_get_perf (struct mrsg_perf_s* perf_out)
+{
+    *perf_out = perf;
+}
+
+void MRSG_set_trace_level (enum trace_level_e level)
+{
+    config.trace_level = level;
+}
+
 // vim: set ts=8 sw=4:
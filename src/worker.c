@@ -17,16 +17,41 @@ along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
 
 #include "common.h"
 #include "dfs.h"
+#include "disk.h"
+#include "objpool.h"
 #include "worker.h"
 
 XBT_LOG_EXTERNAL_DEFAULT_CATEGORY (msg_test);
 
-static void heartbeat (void);
+static void heartbeat (w_info_t wi);
 static int listen (int argc, char* argv[]);
 static int compute (int argc, char* argv[]);
-static void update_map_output (msg_host_t worker, size_t mid);
+static void update_map_output (msg_host_t worker, job_t job, size_t mid);
 static void get_chunk (task_info_t ti);
 static void get_map_output (task_info_t ti);
+static int fetch (int argc, char* argv[]);
+static void push_source (shuffle_t sh, size_t wid);
+static size_t pop_source (shuffle_t sh, double* retry_at);
+static shuffle_t new_shuffle (void);
+static void release_shuffle (shuffle_t sh);
+
+void init_shuffles (job_t job)
+{
+    /* Running shuffles of each reduce task, fed by the map completions. */
+    job->shuffles = xbt_new0 (shuffle_t, job->amount_of_tasks[REDUCE]);
+}
+
+void free_shuffles (job_t job)
+{
+    xbt_free_ref (&job->shuffles);
+}
+
+size_t shuffle_size (void)
+{
+    size_t  n = config.number_of_workers;
+
+    return sizeof (struct shuffle_s) + n * (sizeof (uint64_t) + 2 * sizeof (double) + sizeof (size_t) + 1);
+}
 
 size_t get_worker_id (msg_host_t worker)
 {
@@ -36,6 +61,11 @@ size_t get_worker_id (msg_host_t worker)
     return wi->wid;
 }
 
+w_info_t get_worker_info (size_t wid)
+{
+    return (w_info_t) MSG_host_get_data (config.workers[wid]);
+}
+
 /**
  * @brief  Main worker function.
  *
@@ -44,35 +74,65 @@ size_t get_worker_id (msg_host_t worker)
  */
 int worker (int argc, char* argv[])
 {
-    char           mailbox[MAILBOX_ALIAS_SIZE];
     msg_host_t     me;
+    w_info_t       wi;
 
     me = MSG_host_self ();
+    wi = (w_info_t) MSG_host_get_data (me);
 
     /* Spawn a process that listens for tasks. */
     MSG_process_create ("listen", listen, NULL, me);
     /* Spawn a process to exchange data with other workers. */
     MSG_process_create ("data-node", data_node, NULL, me);
+    /* Spawn a process that serves the disk requests. */
+    if (config.disk_read_bandwidth > 0.0)
+	MSG_process_create ("disk", disk, NULL, me);
     /* Start sending heartbeat signals to the master node. */
-    heartbeat ();
+    heartbeat (wi);
 
-    sprintf (mailbox, DATANODE_MAILBOX, get_worker_id (me));
-    send_sms (SMS_FINISH, mailbox);
-    sprintf (mailbox, TASKTRACKER_MAILBOX, get_worker_id (me));
-    send_sms (SMS_FINISH, mailbox);
+    send_sms (SMS_FINISH, wi->datanode);
+    send_sms (SMS_FINISH, wi->tasktracker);
+    if (config.disk_read_bandwidth > 0.0)
+	send_sms (SMS_FINISH, wi->disk);
 
     return 0;
 }
 
 /**
  * @brief  The heartbeat loop.
+ * @param  wi  The worker information.
+ *
+ * Every heartbeat carries the resources freed since the previous one. In
+ * push mode the master learns about free resources from the task completion
+ * messages, so the heartbeat is only a keepalive. A failed worker is
+ * silent, and its first heartbeat after the recovery says so.
  */
-static void heartbeat (void)
+static void heartbeat (w_info_t wi)
 {
-    while (!job.finished)
+    double     interval;
+    message_t  m;
+
+    if (config.heartbeat_mode == HB_PUSH)
+	interval = config.keepalive_interval;
+    else
+	interval = config.heartbeat_interval;
+
+    while (!workload.finished)
     {
-	send_sms (SMS_HEARTBEAT, MASTER_MAILBOX);
-	MSG_process_sleep (config.heartbeat_interval);
+	if (wi->failed)
+	{
+	    MSG_process_sleep (interval);
+	    continue;
+	}
+
+	m = new_message (SMS_HEARTBEAT, NULL);
+	m->wid = wi->wid;
+	m->heartbeat = wi->freed;
+	m->restarted = wi->restarted;
+	memset (&wi->freed, 0, sizeof (struct resources_s));
+	wi->restarted = 0;
+	send (m, 0.0, MASTER_MAILBOX);
+	MSG_process_sleep (interval);
     }
 }
 
@@ -81,26 +141,26 @@ static void heartbeat (void)
  */
 static int listen (int argc, char* argv[])
 {
-    char         mailbox[MAILBOX_ALIAS_SIZE];
     msg_error_t  status;
     msg_host_t   me;
     msg_task_t   msg = NULL;
+    w_info_t     wi;
 
     me = MSG_host_self ();
-    sprintf (mailbox, TASKTRACKER_MAILBOX, get_worker_id (me));
+    wi = (w_info_t) MSG_host_get_data (me);
 
-    while (!job.finished)
+    while (!workload.finished)
     {
 	msg = NULL;
-	status = receive (&msg, mailbox);
+	status = receive (&msg, wi->tasktracker);
 
-	if (status == MSG_OK && message_is (msg, SMS_TASK))
+	if (status == MSG_OK && message_kind (msg) == SMS_TASK)
 	{
 	    MSG_process_create ("compute", compute, msg, me);
 	}
-	else if (message_is (msg, SMS_FINISH))
+	else if (status == MSG_OK && message_kind (msg) == SMS_FINISH)
 	{
-	    MSG_task_destroy (msg);
+	    destroy_message (msg);
 	    break;
 	}
     }
@@ -110,17 +170,31 @@ static int listen (int argc, char* argv[])
 
 /**
  * @brief  Process that computes a task.
+ *
+ * A copy whose worker fails before it ends is lost: it stops as soon as
+ * possible, and never reports to the master.
  */
 static int compute (int argc, char* argv[])
 {
+    int          incarnation;
+    job_t        job;
     msg_error_t  status;
     msg_task_t   task;
     task_info_t  ti;
+    w_info_t     wi;
     xbt_ex_t     e;
 
     task = (msg_task_t) MSG_process_get_data (MSG_process_self ());
     ti = (task_info_t) MSG_task_get_data (task);
     ti->pid = MSG_process_self_PID ();
+    sprintf (ti->mailbox, TASK_MAILBOX, ti->wid, ti->pid);
+    job = ti->job;
+    wi = get_worker_info (ti->wid);
+    incarnation = wi->incarnation;
+
+    /* Sent before the master noticed the failure. */
+    if (wi->failed)
+	ti->lost = 1;
 
     switch (ti->phase)
     {
@@ -130,17 +204,22 @@ static int compute (int argc, char* argv[])
 
 	case REDUCE:
 	    get_map_output (ti);
+	    if (ti->shuffle_end > 0.0 && job->task_status[REDUCE][ti->id] != T_STATUS_DONE && !ti->killed && !ti->lost)
+		reduce_merge (job, ti->id, ti->mailbox);
 	    break;
     }
 
-    if (job.task_status[ti->phase][ti->id] != T_STATUS_DONE)
+    if (job->task_status[ti->phase][ti->id] != T_STATUS_DONE && !ti->killed && !ti->lost)
     {
 	TRY
 	{
 	    status = MSG_task_execute (task);
 
-	    if (ti->phase == MAP && status == MSG_OK)
-		update_map_output (MSG_host_self (), ti->id);
+	    if (ti->phase == MAP && status == MSG_OK && !ti->lost)
+	    {
+		map_spill (job, ti->id, ti->mailbox);
+		update_map_output (MSG_host_self (), job, ti->id);
+	    }
 	}
 	CATCH (e)
 	{
@@ -149,10 +228,22 @@ static int compute (int argc, char* argv[])
 	}
     }
 
-    job.heartbeats[ti->wid].slots_av[ti->phase]++;
-    
-    if (!job.finished)
-	send (SMS_TASK_DONE, 0.0, 0.0, ti, MASTER_MAILBOX);
+    /* The worker may also have failed and recovered meanwhile. */
+    if (ti->lost || wi->failed || wi->incarnation != incarnation)
+    {
+	ti->lost = 1;
+	release_task_info (ti);
+	return 0;
+    }
+
+    release_resources (&wi->freed, ti->phase);
+
+    if (!workload.finished)
+    {
+	ti->kind = SMS_TASK_DONE;
+	send (ti, 0.0, MASTER_MAILBOX);
+    }
+    release_task_info (ti);
 
     return 0;
 }
@@ -160,17 +251,27 @@ static int compute (int argc, char* argv[])
 /**
  * @brief  Update the amount of data produced by a mapper.
  * @param  worker  The worker that finished a map task.
+ * @param  job     The job of the map task.
  * @param  mid     The ID of map task.
  */
-static void update_map_output (msg_host_t worker, size_t mid)
+static void update_map_output (msg_host_t worker, job_t job, size_t mid)
 {
-    size_t  rid;
-    size_t  wid;
+    size_t     rid;
+    size_t     wid;
+    shuffle_t  sh;
 
     wid = get_worker_id (worker);
+    add_map_output (job, mid, job->map_output[wid]);
 
-    for (rid = 0; rid < config.amount_of_tasks[REDUCE]; rid++)
-	job.map_output[wid][rid] += user.map_output_f (mid, rid);
+    /* Tell the running shuffles that there is new data on this worker. */
+    for (rid = 0; rid < job->amount_of_tasks[REDUCE]; rid++)
+    {
+	for (sh = job->shuffles[rid]; sh != NULL; sh = sh->next)
+	{
+	    if (job->map_output[wid][rid] > sh->copied[wid])
+		push_source (sh, wid);
+	}
+    }
 }
 
 /**
@@ -179,91 +280,305 @@ static void update_map_output (msg_host_t worker, size_t mid)
  */
 static void get_chunk (task_info_t ti)
 {
-    char         mailbox[MAILBOX_ALIAS_SIZE];
     msg_error_t  status;
     msg_task_t   data = NULL;
-    size_t       my_id;
-
-    my_id = get_worker_id (MSG_host_self ());
+    message_t    m;
 
-    /* Request the chunk to the source node. */
-    if (ti->src != my_id)
+    while (!ti->lost)
     {
-	sprintf (mailbox, DATANODE_MAILBOX, ti->src);
-	status = send_sms (SMS_GET_CHUNK, mailbox);
+	/* Request the chunk to the source node. */
+	if (ti->src == ti->wid)
+	{
+	    disk_io (config.chunk_size, 0.0, ti->mailbox);
+	    return;
+	}
+
+	m = new_message (SMS_GET_CHUNK, NULL);
+	m->reply = ti->mailbox;
+	status = send (m, 0.0, get_worker_info (ti->src)->datanode);
 	if (status == MSG_OK)
 	{
-	    sprintf (mailbox, TASK_MAILBOX, my_id, MSG_process_self_PID ());
-	    status = receive (&data, mailbox);
+	    data = NULL;
+	    status = receive (&data, ti->mailbox);
+	    if (status == MSG_OK && message_kind (data) != SMS_DATA_LOST)
+	    {
+		destroy_message (data);
+		return;
+	    }
 	    if (status == MSG_OK)
-		MSG_task_destroy (data);
+		destroy_message (data);
 	}
+
+	/* The source failed: wait and try another replica, or wait for a
+	 * lost worker with a replica to come back. */
+	do
+	{
+	    MSG_process_sleep (DFS_RETRY_INTERVAL);
+	    ti->src = find_closest_chunk_owner (ti->job, ti->id, ti->wid);
+	} while (ti->src == NONE && !ti->lost);
     }
 }
 
 /**
  * @brief  Copy the itermediary pairs for a reduce task.
  * @param  ti  The task information.
+ *
+ * The copy is done by config.parallel_copies fetcher processes, which
+ * share the copy progress. The call returns when all the data was copied,
+ * or when the task was finished by another instance.
  */
 static void get_map_output (task_info_t ti)
 {
-    char         mailbox[MAILBOX_ALIAS_SIZE];
-    msg_error_t  status;
-    msg_task_t   data = NULL;
-    size_t       total_copied, must_copy;
-    size_t       my_id;
+    int          i;
+    job_t        job = ti->job;
+    msg_task_t   msg = NULL;
+    shuffle_t    sh;
+    shuffle_t*   prev;
     size_t       wid;
-    size_t*      data_copied;
 
-    my_id = get_worker_id (MSG_host_self ());
-    data_copied = xbt_new0 (size_t, config.number_of_workers);
-    ti->map_output_copied = data_copied;
-    total_copied = 0;
-    must_copy = reduce_input_size (ti->id);
+    if (reduce_input_size (job, ti->id) == 0)
+    {
+	ti->shuffle_end = sim_clock ();
+	return;
+    }
+
+    sh = new_shuffle ();
+    sh->job = job;
+    sh->ti = ti;
+    sh->rid = ti->id;
+    sh->refs = config.parallel_copies + 1;
+    sh->must_copy = reduce_input_size (job, ti->id);
+    sh->parent = ti->mailbox;
+
+    sh->next = job->shuffles[ti->id];
+    job->shuffles[ti->id] = sh;
+
+    for (wid = 0; wid < config.number_of_workers; wid++)
+    {
+	if (job->map_output[wid][ti->id] > 0)
+	    push_source (sh, wid);
+    }
 
 #ifdef VERBOSE
     XBT_INFO ("INFO: start copy");
 #endif
 
-    while (total_copied < must_copy)
+    for (i = 0; i < config.parallel_copies; i++)
+	MSG_process_create ("fetch", fetch, sh, MSG_host_self ());
+
+    /* Wait until the fetchers are done. */
+    receive (&msg, sh->parent);
+    destroy_message (msg);
+
+    if (sh->total_copied >= sh->must_copy)
+    {
+#ifdef VERBOSE
+	XBT_INFO ("INFO: copy finished");
+#endif
+	ti->shuffle_end = sim_clock ();
+    }
+
+    /* Stop receiving new sources. */
+    prev = &job->shuffles[ti->id];
+    while (*prev != sh)
+	prev = &(*prev)->next;
+    *prev = sh->next;
+
+    release_shuffle (sh);
+}
+
+/**
+ * @brief  Process that copies map output for a reduce task.
+ *
+ * Takes the next worker with pending output that is not backed off from
+ * the shared queue and copies everything it has. A failed copy puts the
+ * worker in backoff, starting at COPY_BACKOFF_INIT seconds and doubling
+ * up to config.copy_backoff (mapred.reduce.copy.backoff).
+ */
+static int fetch (int argc, char* argv[])
+{
+    char         mailbox[MAILBOX_ALIAS_SIZE];
+    double       copy_start;
+    message_t    m;
+    msg_error_t  status;
+    msg_task_t   msg;
+    shuffle_t    sh;
+    size_t       wid;
+    double       retry_at;
+
+    sh = (shuffle_t) MSG_process_get_data (MSG_process_self ());
+    sprintf (mailbox, TASK_MAILBOX, get_worker_id (MSG_host_self ()), MSG_process_self_PID ());
+
+    while (!sh->notified
+	    && sh->total_copied < sh->must_copy
+	    && sh->job->task_status[REDUCE][sh->rid] != T_STATUS_DONE
+	    && !sh->ti->killed
+	    && !sh->ti->lost)
     {
-	for (wid = 0; wid < config.number_of_workers; wid++)
+	wid = pop_source (sh, &retry_at);
+
+	if (wid == NONE)
+	{
+	    /* Every queued source is backed off: wait for the first one,
+	     * or for new output. (Hadoop 0.20.2) mapred/ReduceTask.java:1979 */
+	    if (retry_at > sim_clock () && retry_at - sim_clock () < COPY_POLL_INTERVAL)
+		MSG_process_sleep (retry_at - sim_clock ());
+	    else
+		MSG_process_sleep (COPY_POLL_INTERVAL);
+	    continue;
+	}
+
+	copy_start = sim_clock ();
+	m = new_message (SMS_GET_INTER_PAIRS, sh);
+	m->reply = mailbox;
+	msg = MSG_task_create (message_name (SMS_GET_INTER_PAIRS), 0.0, 0.0, m);
+	status = MSG_task_send_with_timeout (msg, get_worker_info (wid)->datanode, config.copy_backoff);
+	if (status == MSG_OK)
 	{
-	    if (job.task_status[REDUCE][ti->id] == T_STATUS_DONE)
+	    msg = NULL;
+	    status = receive (&msg, mailbox);
+	    if (status == MSG_OK && message_kind (msg) == SMS_DATA_LOST)
 	    {
-		xbt_free_ref (&data_copied);
-		return;
+		/* The source failed, so back off as after a timeout. */
+		destroy_message (msg);
+		status = MSG_TRANSFER_FAILURE;
 	    }
-
-	    if (job.map_output[wid][ti->id] > data_copied[wid])
+	    else if (status == MSG_OK)
 	    {
-		sprintf (mailbox, DATANODE_MAILBOX, wid);
-		status = send (SMS_GET_INTER_PAIRS, 0.0, 0.0, ti, mailbox);
-		if (status == MSG_OK)
-		{
-		    sprintf (mailbox, TASK_MAILBOX, my_id, MSG_process_self_PID ());
-		    data = NULL;
-		    //TODO Set a timeout: reduce.copy.backoff
-		    status = receive (&data, mailbox);
-		    if (status == MSG_OK)
-		    {
-			data_copied[wid] += MSG_task_get_data_size (data);
-			total_copied += MSG_task_get_data_size (data);
-			MSG_task_destroy (data);
-		    }
-		}
+		sh->copied[wid] += MSG_task_get_data_size (msg);
+		sh->total_copied += MSG_task_get_data_size (msg);
+		workload.copy_bytes += MSG_task_get_data_size (msg);
+		workload.copy_time += sim_clock () - copy_start;
+		destroy_message (msg);
 	    }
 	}
-	/* (Hadoop 0.20.2) mapred/ReduceTask.java:1979 */
-	MSG_process_sleep (5);
+	else
+	{
+	    destroy_message (msg);
+	}
+
+	if (status == MSG_OK)
+	{
+	    sh->penalty[wid] = 0.0;
+	}
+	else
+	{
+	    if (sh->penalty[wid] == 0.0)
+		sh->penalty[wid] = COPY_BACKOFF_INIT;
+	    else if (2 * sh->penalty[wid] < config.copy_backoff)
+		sh->penalty[wid] *= 2;
+	    else
+		sh->penalty[wid] = config.copy_backoff;
+	    sh->retry_at[wid] = sim_clock () + sh->penalty[wid];
+	}
+
+	sh->state[wid] = SRC_IDLE;
+	if (sh->job->map_output[wid][sh->rid] > sh->copied[wid])
+	    push_source (sh, wid);
     }
 
-#ifdef VERBOSE
-    XBT_INFO ("INFO: copy finished");
-#endif
-    ti->shuffle_end = MSG_get_clock ();
+    /* The first fetcher to stop wakes up the reduce task. */
+    if (!sh->notified)
+    {
+	sh->notified = 1;
+	send_sms (SMS_FINISH, sh->parent);
+    }
 
-    xbt_free_ref (&data_copied);
+    release_shuffle (sh);
+
+    return 0;
+}
+
+/**
+ * @brief  Queue a worker whose output must be copied.
+ * @param  sh   The shuffle.
+ * @param  wid  The worker ID.
+ */
+static void push_source (shuffle_t sh, size_t wid)
+{
+    if (sh->state[wid] != SRC_IDLE)
+	return;
+
+    sh->queue[(sh->queue_head + sh->queue_count) % config.number_of_workers] = wid;
+    sh->queue_count++;
+    sh->state[wid] = SRC_QUEUED;
+}
+
+/**
+ * @brief  Take the next worker to copy from that is not backed off.
+ * @param  sh        The shuffle.
+ * @param  retry_at  Set to the earliest retry time of the queued workers,
+ *                   or to 0 if the queue is empty, when none is ready.
+ * @return The worker ID, or NONE if no queued worker is ready.
+ */
+static size_t pop_source (shuffle_t sh, double* retry_at)
+{
+    size_t  i;
+    size_t  n = config.number_of_workers;
+    size_t  wid;
+
+    *retry_at = 0.0;
+
+    for (i = 0; i < sh->queue_count; i++)
+    {
+	wid = sh->queue[(sh->queue_head + i) % n];
+	if (sh->retry_at[wid] <= sim_clock ())
+	    break;
+	if (i == 0 || sh->retry_at[wid] < *retry_at)
+	    *retry_at = sh->retry_at[wid];
+    }
+
+    if (i == sh->queue_count)
+	return NONE;
+
+    /* Close the gap, so the backed off workers keep their turn. */
+    for (; i > 0; i--)
+	sh->queue[(sh->queue_head + i) % n] = sh->queue[(sh->queue_head + i - 1) % n];
+    sh->queue_head = (sh->queue_head + 1) % n;
+    sh->queue_count--;
+    sh->state[wid] = SRC_BUSY;
+
+    return wid;
+}
+
+/**
+ * @brief  Drop a reference to a shuffle, and free it with the last one.
+ * @param  sh  The shuffle.
+ */
+static void release_shuffle (shuffle_t sh)
+{
+    if (--sh->refs > 0)
+	return;
+
+    obj_pool_put (&obj_pools.shuffles, sh);
+}
+
+/**
+ * @brief  Take a shuffle from the pool.
+ * @return A zeroed shuffle.
+ *
+ * The per-worker arrays are carved from the same object, so a reduce
+ * attempt costs no allocation once the pool is warm.
+ */
+static shuffle_t new_shuffle (void)
+{
+    char*      p;
+    size_t     n = config.number_of_workers;
+    shuffle_t  sh;
+
+    sh = (shuffle_t) obj_pool_get (&obj_pools.shuffles);
+    p = (char*) (sh + 1);
+    sh->copied = (uint64_t*) p;
+    p += n * sizeof (uint64_t);
+    sh->penalty = (double*) p;
+    p += n * sizeof (double);
+    sh->retry_at = (double*) p;
+    p += n * sizeof (double);
+    sh->queue = (size_t*) p;
+    p += n * sizeof (size_t);
+    sh->state = p;
+
+    return sh;
 }
 
 // vim: set ts=8 sw=4:
@@ -0,0 +1,101 @@
+/* Copyright (c) 2012. MRSG Team. All rights reserved. */
+
+/* This file is part of MRSG.
+
+MRSG is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+MRSG is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with MRSG.  If not, see <http://www.gnu.org/licenses/>. */
+
+
+/* Convert a binary task event trace to the tasks.csv format.
+ *
+ * Usage: trace2csv [trace [csv]]
+ * The defaults are tasks.evt and the standard output. */
+
+#include <stdio.h>
+#include <string.h>
+#include "trace.h"
+
+int main (int argc, char* argv[])
+{
+    const char*            in_name = "tasks.evt";
+    const char*            phase;
+    FILE*                  in;
+    FILE*                  out = stdout;
+    size_t                 count;
+    size_t                 i;
+    struct task_event_s    events[4096];
+    struct trace_header_s  header;
+
+    if (argc > 1)
+	in_name = argv[1];
+
+    in = fopen (in_name, "rb");
+    if (in == NULL)
+    {
+	fprintf (stderr, "Error: can't open %s\n", in_name);
+	return 1;
+    }
+
+    if (fread (&header, sizeof (header), 1, in) != 1
+	    || memcmp (header.magic, TRACE_MAGIC, sizeof (header.magic)) != 0
+	    || header.record_size != sizeof (struct task_event_s))
+    {
+	fprintf (stderr, "Error: %s is not a task trace of this version\n", in_name);
+	return 1;
+    }
+
+    if (argc > 2)
+    {
+	out = fopen (argv[2], "w");
+	if (out == NULL)
+	{
+	    fprintf (stderr, "Error: can't open %s\n", argv[2]);
+	    return 1;
+	}
+    }
+
+    fprintf (out, "job_id,task_id,phase,worker_id,time,action,shuffle_end\n");
+
+    while ((count = fread (events, sizeof (struct task_event_s), 4096, in)) > 0)
+    {
+	for (i = 0; i < count; i++)
+	{
+	    phase = (events[i].phase == MAP ? "MAP" : "REDUCE");
+	    fprintf (out, "%u,%d_%u_%d,%s,%u,%.3f,", events[i].job, events[i].phase, events[i].tid,
+		    events[i].instance, phase, events[i].wid, events[i].time);
+
+	    switch (events[i].action)
+	    {
+		case EV_START:
+		    fprintf (out, "START,\n");
+		    break;
+
+		case EV_END:
+		    fprintf (out, "END,%.3f\n", events[i].shuffle_end);
+		    break;
+
+		case EV_KILL:
+		    fprintf (out, "KILL,\n");
+		    break;
+	    }
+	}
+    }
+
+    fclose (in);
+    if (out != stdout)
+	fclose (out);
+
+    return 0;
+}
+
+// vim: set ts=8 sw=4: